@@ -0,0 +1,297 @@
+#include "Common.h"
+
+#include "Base64.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSSE3__)
+#define BATANG_BASE64_SSSE3
+#include <tmmintrin.h>
+#endif
+
+namespace Batang
+{
+    namespace
+    {
+        const char EncodeTable[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+        struct DecodeTable
+        {
+            uint8_t values_[256]; // 0x80 for characters outside the alphabet
+
+            DecodeTable()
+            {
+                std::fill(std::begin(values_), std::end(values_), 0x80);
+                for(uint8_t i = 0; i < 64; ++ i)
+                    values_[static_cast<uint8_t>(EncodeTable[i])] = i;
+            }
+        };
+
+        const DecodeTable decodeTable;
+
+        bool isWhitespace(char ch)
+        {
+            return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n';
+        }
+
+#ifdef BATANG_BASE64_SSSE3
+        // SSSE3 is not part of the baseline of the Win32 target, so the vector kernels are chosen at run time.
+        bool hasSsse3()
+        {
+#ifdef _MSC_VER
+            int info[4];
+            __cpuid(info, 1);
+            return (info[2] & (1 << 9)) != 0;
+#else
+            return __builtin_cpu_supports("ssse3") != 0;
+#endif
+        }
+
+        const bool useSsse3 = hasSsse3();
+
+        // 12 bytes to 16 characters; reads 16 bytes. See Wojciech Mula, "Base64 encoding with SIMD instructions".
+        inline __m128i encodeVector(__m128i in)
+        {
+            in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+
+            __m128i high = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0FC0FC00)), _mm_set1_epi32(0x04000040));
+            __m128i low = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003F03F0)), _mm_set1_epi32(0x01000010));
+            __m128i indices = _mm_or_si128(high, low);
+
+            // map each range of the alphabet to the offset from its index to its character
+            __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+            range = _mm_or_si128(range, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices), _mm_set1_epi8(13)));
+            __m128i offsets = _mm_setr_epi8(
+                'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+            return _mm_add_epi8(indices, _mm_shuffle_epi8(offsets, range));
+        }
+
+        // 16 characters to 12 bytes in the low lanes; false if any character is outside the alphabet.
+        inline bool decodeVector(__m128i in, __m128i &out)
+        {
+            __m128i highNibbles = _mm_and_si128(_mm_srli_epi32(in, 4), _mm_set1_epi8(0x0F));
+            __m128i lowNibbles = _mm_and_si128(in, _mm_set1_epi8(0x0F));
+
+            __m128i lowClasses = _mm_shuffle_epi8(_mm_setr_epi8(
+                0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A), lowNibbles);
+            __m128i highClasses = _mm_shuffle_epi8(_mm_setr_epi8(
+                0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10), highNibbles);
+            if(_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lowClasses, highClasses), _mm_setzero_si128())) != 0)
+                return false;
+
+            __m128i isSlash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+            __m128i offsets = _mm_shuffle_epi8(_mm_setr_epi8(
+                0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0), _mm_add_epi8(isSlash, highNibbles));
+            __m128i values = _mm_add_epi8(in, offsets);
+
+            __m128i pairs = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+            __m128i triples = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+            out = _mm_shuffle_epi8(triples, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+            return true;
+        }
+#endif
+
+        // Encodes size / 3 whole groups; returns characters written.
+        size_t encodeGroups(const uint8_t *src, size_t size, char *dst)
+        {
+            char *out = dst;
+            size_t i = 0;
+
+#ifdef BATANG_BASE64_SSSE3
+            if(useSsse3)
+            {
+                for(; i + 16 <= size; i += 12, out += 16)
+                {
+                    __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), encodeVector(in));
+                }
+            }
+#endif
+
+            for(; i + 3 <= size; i += 3)
+            {
+                uint32_t bits = (src[i] << 16) | (src[i + 1] << 8) | src[i + 2];
+                *out ++ = EncodeTable[bits >> 18];
+                *out ++ = EncodeTable[(bits >> 12) & 0x3F];
+                *out ++ = EncodeTable[(bits >> 6) & 0x3F];
+                *out ++ = EncodeTable[bits & 0x3F];
+            }
+
+            return out - dst;
+        }
+
+        // Decodes whole groups up to the first one holding padding, whitespace or an invalid character.
+        // Returns characters consumed; written receives bytes written.
+        size_t decodeGroups(const char *src, size_t size, uint8_t *dst, size_t &written)
+        {
+            const uint8_t *in = reinterpret_cast<const uint8_t *>(src);
+            uint8_t *out = dst;
+            size_t i = 0;
+
+#ifdef BATANG_BASE64_SSSE3
+            if(useSsse3)
+            {
+                for(; i + 16 <= size; i += 16, out += 12)
+                {
+                    __m128i bytes;
+                    if(!decodeVector(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i)), bytes))
+                        break;
+
+                    alignas(16) uint8_t block[16];
+                    _mm_store_si128(reinterpret_cast<__m128i *>(block), bytes);
+                    std::memcpy(out, block, 12);
+                }
+            }
+#endif
+
+            for(; i + 4 <= size; i += 4)
+            {
+                uint32_t a = decodeTable.values_[in[i]], b = decodeTable.values_[in[i + 1]];
+                uint32_t c = decodeTable.values_[in[i + 2]], d = decodeTable.values_[in[i + 3]];
+                if((a | b | c | d) & 0x80)
+                    break;
+
+                uint32_t bits = (a << 18) | (b << 12) | (c << 6) | d;
+                *out ++ = static_cast<uint8_t>(bits >> 16);
+                *out ++ = static_cast<uint8_t>(bits >> 8);
+                *out ++ = static_cast<uint8_t>(bits);
+            }
+
+            written = out - dst;
+            return i;
+        }
+    }
+
+    Base64Encoder::Base64Encoder()
+        : pendingSize_(0)
+    {
+    }
+
+    void Base64Encoder::encode(const void *data, size_t size, std::string &out)
+    {
+        const uint8_t *src = static_cast<const uint8_t *>(data);
+
+        // complete the group left over from the previous chunk
+        if(pendingSize_ > 0)
+        {
+            for(; pendingSize_ < 3 && size > 0; -- size)
+                pending_[pendingSize_ ++] = *src ++;
+            if(pendingSize_ < 3)
+                return;
+
+            size_t base = out.size();
+            out.resize(base + 4);
+            encodeGroups(pending_, 3, &out[base]);
+            pendingSize_ = 0;
+        }
+
+        size_t groupBytes = size / 3 * 3;
+        size_t base = out.size();
+        out.resize(base + groupBytes / 3 * 4);
+        encodeGroups(src, groupBytes, &out[0] + base);
+
+        for(size_t i = groupBytes; i < size; ++ i)
+            pending_[pendingSize_ ++] = src[i];
+    }
+
+    void Base64Encoder::finish(std::string &out)
+    {
+        if(pendingSize_ == 0)
+            return;
+
+        uint32_t bits = pending_[0] << 16;
+        if(pendingSize_ > 1)
+            bits |= pending_[1] << 8;
+
+        out.push_back(EncodeTable[bits >> 18]);
+        out.push_back(EncodeTable[(bits >> 12) & 0x3F]);
+        out.push_back(pendingSize_ > 1 ? EncodeTable[(bits >> 6) & 0x3F] : '=');
+        out.push_back('=');
+
+        pendingSize_ = 0;
+    }
+
+    Base64Decoder::Base64Decoder()
+        : bits_(0)
+        , pendingSize_(0)
+        , paddingSize_(0)
+    {
+    }
+
+    void Base64Decoder::decode(const char *src, size_t size, std::vector<uint8_t> &out)
+    {
+        size_t base = out.size();
+        out.resize(base + (pendingSize_ + paddingSize_ + size) / 4 * 3);
+        uint8_t *dst = out.data() + base;
+
+        size_t i = 0;
+        while(i < size)
+        {
+            if(pendingSize_ == 0 && paddingSize_ == 0)
+            {
+                size_t written;
+                i += decodeGroups(src + i, size - i, dst, written);
+                dst += written;
+                if(i == size)
+                    break;
+            }
+
+            char ch = src[i ++];
+            uint8_t value = decodeTable.values_[static_cast<uint8_t>(ch)];
+            if(value < 64)
+            {
+                if(paddingSize_ > 0)
+                    throw(std::runtime_error("Base64Decoder: data after padding"));
+
+                bits_ = (bits_ << 6) | value;
+                if(++ pendingSize_ == 4)
+                {
+                    *dst ++ = static_cast<uint8_t>(bits_ >> 16);
+                    *dst ++ = static_cast<uint8_t>(bits_ >> 8);
+                    *dst ++ = static_cast<uint8_t>(bits_);
+                    bits_ = 0;
+                    pendingSize_ = 0;
+                }
+            }
+            else if(ch == '=')
+            {
+                if(pendingSize_ < 2 || pendingSize_ + ++ paddingSize_ > 4)
+                    throw(std::runtime_error("Base64Decoder: misplaced padding"));
+
+                if(pendingSize_ + paddingSize_ == 4)
+                {
+                    bits_ <<= 6 * paddingSize_;
+                    *dst ++ = static_cast<uint8_t>(bits_ >> 16);
+                    if(pendingSize_ == 3)
+                        *dst ++ = static_cast<uint8_t>(bits_ >> 8);
+                    bits_ = 0;
+                    pendingSize_ = 0; // paddingSize_ stays nonzero to reject anything but whitespace from now on
+                }
+            }
+            else if(!isWhitespace(ch))
+            {
+                throw(std::runtime_error("Base64Decoder: invalid character"));
+            }
+        }
+
+        out.resize(dst - out.data());
+    }
+
+    void Base64Decoder::finish(std::vector<uint8_t> &out)
+    {
+        if(pendingSize_ == 1 || (pendingSize_ > 0 && paddingSize_ > 0))
+            throw(std::runtime_error("Base64Decoder: truncated input"));
+
+        if(pendingSize_ > 1)
+        {
+            bits_ <<= 6 * (4 - pendingSize_);
+            out.push_back(static_cast<uint8_t>(bits_ >> 16));
+            if(pendingSize_ == 3)
+                out.push_back(static_cast<uint8_t>(bits_ >> 8));
+        }
+
+        bits_ = 0;
+        pendingSize_ = 0;
+        paddingSize_ = 0;
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+namespace Batang
+{
+    // Incremental base64 (RFC 4648) encoder; feed any number of chunks, then call finish() once.
+    class Base64Encoder
+    {
+    private:
+        uint8_t pending_[3];
+        size_t pendingSize_;
+
+    public:
+        Base64Encoder();
+
+    public:
+        void encode(const void *, size_t, std::string &); // appends to the last argument
+        void finish(std::string &); // writes the last group with padding and resets
+    };
+
+    // Incremental base64 decoder. Whitespace is ignored and trailing padding may be omitted;
+    // any other character outside the alphabet throws std::runtime_error.
+    class Base64Decoder
+    {
+    private:
+        uint32_t bits_;
+        size_t pendingSize_; // sextets in bits_
+        size_t paddingSize_; // '=' seen; nonzero once the data has ended
+
+    public:
+        Base64Decoder();
+
+    public:
+        void decode(const char *, size_t, std::vector<uint8_t> &); // appends to the last argument
+        void finish(std::vector<uint8_t> &); // writes an unpadded last group and resets
+    };
+}
@@ -0,0 +1,190 @@
+#include "Common.h"
+
+#include "ChunkBuffer.h"
+
+namespace Batang
+{
+    const size_t ChunkPool::ChunkSize = 16 * 1024;
+    const size_t ChunkPool::MaxPooled = 64;
+
+    ChunkPool::ChunkPool()
+        : stats_()
+    {
+    }
+
+    ChunkPool::~ChunkPool()
+    {
+    }
+
+    std::unique_ptr<uint8_t[]> ChunkPool::acquire()
+    {
+        std::unique_ptr<uint8_t[]> chunk;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stats_.inUse_ += ChunkSize;
+            stats_.peakInUse_ = std::max(stats_.peakInUse_, stats_.inUse_);
+
+            if(!free_.empty())
+            {
+                chunk = std::move(free_.back());
+                free_.pop_back();
+                stats_.pooled_ -= ChunkSize;
+                ++ stats_.reuses_;
+                return chunk;
+            }
+
+            ++ stats_.allocations_;
+        }
+
+        chunk.reset(new uint8_t[ChunkSize]);
+        return chunk;
+    }
+
+    void ChunkPool::release(std::unique_ptr<uint8_t[]> chunk)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.inUse_ -= ChunkSize;
+
+        if(free_.size() < MaxPooled)
+        {
+            free_.push_back(std::move(chunk));
+            stats_.pooled_ += ChunkSize;
+        }
+    }
+
+    void ChunkPool::countCopy(size_t in, size_t out)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.copiedIn_ += in;
+        stats_.copiedOut_ += out;
+    }
+
+    ChunkPool::Stats ChunkPool::stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+    ChunkBuffer::ChunkBuffer()
+        : size_(0)
+    {
+    }
+
+    ChunkBuffer::ChunkBuffer(ChunkBuffer &&rhs)
+        : chunks_(std::move(rhs.chunks_))
+        , size_(rhs.size_)
+    {
+        rhs.chunks_.clear();
+        rhs.size_ = 0;
+    }
+
+    ChunkBuffer::~ChunkBuffer()
+    {
+        clear();
+    }
+
+    ChunkBuffer &ChunkBuffer::operator =(ChunkBuffer &&rhs)
+    {
+        if(this != &rhs)
+        {
+            clear();
+            chunks_ = std::move(rhs.chunks_);
+            size_ = rhs.size_;
+            rhs.chunks_.clear();
+            rhs.size_ = 0;
+        }
+        return *this;
+    }
+
+    void ChunkBuffer::append(const void *data, size_t size)
+    {
+        auto &pool = ChunkPool::instance();
+        const uint8_t *p = static_cast<const uint8_t *>(data);
+        size_t left = size;
+
+        while(left > 0)
+        {
+            size_t used = size_ - (chunks_.empty() ? 0 : (chunks_.size() - 1) * ChunkPool::ChunkSize);
+            if(chunks_.empty() || used == ChunkPool::ChunkSize)
+            {
+                chunks_.push_back(pool.acquire());
+                used = 0;
+            }
+
+            size_t toCopy = std::min(left, ChunkPool::ChunkSize - used);
+            std::memcpy(chunks_.back().get() + used, p, toCopy);
+            p += toCopy;
+            left -= toCopy;
+            size_ += toCopy;
+        }
+
+        pool.countCopy(size, 0);
+    }
+
+    void ChunkBuffer::clear()
+    {
+        if(chunks_.empty())
+            return;
+
+        auto &pool = ChunkPool::instance();
+        for(auto &chunk: chunks_)
+            pool.release(std::move(chunk));
+        chunks_.clear();
+        size_ = 0;
+    }
+
+    size_t ChunkBuffer::size() const
+    {
+        return size_;
+    }
+
+    bool ChunkBuffer::empty() const
+    {
+        return size_ == 0;
+    }
+
+    size_t ChunkBuffer::chunkCount() const
+    {
+        return chunks_.size();
+    }
+
+    boost::string_view ChunkBuffer::chunk(size_t index) const
+    {
+        size_t offset = index * ChunkPool::ChunkSize;
+        return boost::string_view(reinterpret_cast<const char *>(chunks_[index].get()), std::min(size_ - offset, ChunkPool::ChunkSize));
+    }
+
+    ChunkBuffer::const_iterator ChunkBuffer::begin() const
+    {
+        return const_iterator(this, 0, 0);
+    }
+
+    ChunkBuffer::const_iterator ChunkBuffer::end() const
+    {
+        // a full last chunk ends at the start of the next one, as operator ++ leaves it
+        return const_iterator(this, size_ / ChunkPool::ChunkSize, size_ % ChunkPool::ChunkSize);
+    }
+
+    void ChunkBuffer::copyTo(void *out) const
+    {
+        uint8_t *p = static_cast<uint8_t *>(out);
+        for(size_t i = 0; i < chunks_.size(); ++ i)
+        {
+            auto piece = chunk(i);
+            std::memcpy(p, piece.data(), piece.size());
+            p += piece.size();
+        }
+
+        if(size_ > 0)
+            ChunkPool::instance().countCopy(0, size_);
+    }
+
+    std::string ChunkBuffer::str() const
+    {
+        std::string out(size_, '\0');
+        if(size_ > 0)
+            copyTo(&out[0]);
+        return out;
+    }
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "Singleton.h"
+
+namespace Batang
+{
+    // Fixed-size chunks recycled across buffers, so receiving a response allocates nothing
+    // once the pool is warm.
+    class ChunkPool final : public Singleton<ChunkPool, DestructPriority::Latest, ExitBehavior::Skip>
+    {
+    public:
+        static const size_t ChunkSize; // curl's largest write
+        static const size_t MaxPooled; // free chunks kept; more are freed
+
+        struct Stats
+        {
+            size_t inUse_; // bytes held by buffers
+            size_t peakInUse_;
+            size_t pooled_; // bytes kept for reuse
+            uint64_t allocations_;
+            uint64_t reuses_;
+            uint64_t copiedIn_; // bytes appended to buffers
+            uint64_t copiedOut_; // bytes flattened out of buffers by str() or copyTo()
+        };
+
+    private:
+        mutable std::mutex mutex_;
+        std::vector<std::unique_ptr<uint8_t[]>> free_;
+        Stats stats_;
+
+    private:
+        ChunkPool();
+        ~ChunkPool();
+
+    public:
+        std::unique_ptr<uint8_t[]> acquire();
+        void release(std::unique_ptr<uint8_t[]>);
+        void countCopy(size_t in, size_t out);
+        Stats stats() const;
+
+        friend class Singleton<ChunkPool, DestructPriority::Latest, ExitBehavior::Skip>;
+    };
+
+    // Byte buffer made of pooled chunks; appending never moves what is already stored.
+    // Readers either walk the chunks (scatter view) or the bytes through const_iterator.
+    class ChunkBuffer final
+    {
+    public:
+        class const_iterator
+        {
+        public:
+            typedef std::forward_iterator_tag iterator_category;
+            typedef char value_type;
+            typedef ptrdiff_t difference_type;
+            typedef const char *pointer;
+            typedef const char &reference;
+
+        private:
+            const ChunkBuffer *buffer_;
+            size_t chunk_;
+            size_t offset_;
+
+        public:
+            const_iterator()
+                : buffer_(nullptr)
+                , chunk_(0)
+                , offset_(0)
+            {
+            }
+
+            const_iterator(const ChunkBuffer *buffer, size_t chunk, size_t offset)
+                : buffer_(buffer)
+                , chunk_(chunk)
+                , offset_(offset)
+            {
+            }
+
+        public:
+            const char &operator *() const
+            {
+                return reinterpret_cast<const char &>(buffer_->chunks_[chunk_][offset_]);
+            }
+
+            const_iterator &operator ++()
+            {
+                if(++ offset_ == ChunkPool::ChunkSize)
+                {
+                    ++ chunk_;
+                    offset_ = 0;
+                }
+                return *this;
+            }
+
+            const_iterator operator ++(int)
+            {
+                const_iterator it = *this;
+                ++ *this;
+                return it;
+            }
+
+            bool operator ==(const const_iterator &rhs) const
+            {
+                return chunk_ == rhs.chunk_ && offset_ == rhs.offset_;
+            }
+
+            bool operator !=(const const_iterator &rhs) const
+            {
+                return !(*this == rhs);
+            }
+        };
+
+    private:
+        std::vector<std::unique_ptr<uint8_t[]>> chunks_;
+        size_t size_; // the last chunk holds size_ - (chunks_.size() - 1) * ChunkSize bytes
+
+    public:
+        ChunkBuffer();
+        ChunkBuffer(ChunkBuffer &&);
+        ~ChunkBuffer();
+
+    private:
+        ChunkBuffer(const ChunkBuffer &) = delete;
+        ChunkBuffer &operator =(const ChunkBuffer &) = delete;
+
+    public:
+        ChunkBuffer &operator =(ChunkBuffer &&);
+
+    public:
+        void append(const void *, size_t);
+        void clear(); // gives the chunks back to the pool
+
+        size_t size() const;
+        bool empty() const;
+        size_t chunkCount() const;
+        boost::string_view chunk(size_t) const;
+
+        const_iterator begin() const;
+        const_iterator end() const;
+
+        void copyTo(void *) const; // size() bytes
+        std::string str() const;
+    };
+}
@@ -13,6 +13,8 @@
 // Standard C/C++ library & boost library inclusion
 
 #include <cassert>
+#include <cstdlib>
+#include <cstring>
 
 #include <algorithm>
 #include <atomic>
@@ -21,9 +23,11 @@
 #include <deque>
 #include <functional>
 #include <future>
+#include <iomanip>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <sstream>
 #include <stdexcept>
 #include <string>
 #include <thread>
@@ -51,6 +55,7 @@
 #include <boost/thread/once.hpp>
 #include <boost/thread/tss.hpp>
 #include <boost/type_traits/function_traits.hpp>
+#include <boost/utility/string_view.hpp>
 #include <boost/filesystem.hpp>
 
 using std::max; using std::min;
@@ -6,6 +6,9 @@ namespace Batang
     {
         class Task
         {
+        public:
+            virtual ~Task() {}
+
         public:
             virtual void operator ()() = 0;
         };
@@ -9,6 +9,8 @@ namespace Batang
     namespace Detail
     {
         TimerThread::TimerThread()
+            : nextTickDuration_()
+            , toEnd_(false)
         {
         }
 
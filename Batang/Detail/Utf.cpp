@@ -0,0 +1,282 @@
+#include "Common.h"
+
+#include "Utf.h"
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define BATANG_UTF_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace Batang
+{
+    namespace Detail
+    {
+        // The vector paths only cover runs which need no change of width (ASCII, or BMP without surrogates);
+        // they are tried again only after an ASCII unit so that CJK-heavy text does not pay for a failing probe
+        // on every character.
+
+        size_t utf16ToUtf8(const char16_t *src, size_t size, char *dst)
+        {
+            char *out = dst;
+            size_t i = 0;
+
+            while(i < size)
+            {
+#ifdef BATANG_UTF_SSE2
+                while(i + 16 <= size)
+                {
+                    __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+                    __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 8));
+                    __m128i nonAscii = _mm_and_si128(_mm_or_si128(lo, hi), _mm_set1_epi16(static_cast<short>(0xFF80)));
+                    if(_mm_movemask_epi8(_mm_cmpeq_epi16(nonAscii, _mm_setzero_si128())) != 0xFFFF)
+                        break;
+
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_packus_epi16(lo, hi));
+                    i += 16;
+                    out += 16;
+                }
+#endif
+
+                for(; i < size; ++ i)
+                {
+                    uint32_t ch = src[i];
+                    if(ch < 0x80)
+                    {
+                        *out ++ = static_cast<char>(ch);
+                        ++ i;
+                        break; // back to the vector path
+                    }
+                    else if(ch < 0x800)
+                    {
+                        *out ++ = static_cast<char>(0xC0 | (ch >> 6));
+                        *out ++ = static_cast<char>(0x80 | (ch & 0x3F));
+                    }
+                    else if(ch - 0xD800 >= 0x800)
+                    {
+                        *out ++ = static_cast<char>(0xE0 | (ch >> 12));
+                        *out ++ = static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+                        *out ++ = static_cast<char>(0x80 | (ch & 0x3F));
+                    }
+                    else if(ch < 0xDC00 && i + 1 < size && static_cast<uint32_t>(src[i + 1]) - 0xDC00 < 0x400)
+                    {
+                        ch = 0x10000 + ((ch - 0xD800) << 10) + (src[++ i] - 0xDC00);
+                        *out ++ = static_cast<char>(0xF0 | (ch >> 18));
+                        *out ++ = static_cast<char>(0x80 | ((ch >> 12) & 0x3F));
+                        *out ++ = static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+                        *out ++ = static_cast<char>(0x80 | (ch & 0x3F));
+                    }
+                    // else a lone surrogate; dropped
+                }
+            }
+
+            return out - dst;
+        }
+
+        size_t utf8ToUtf16(const char *src, size_t size, char16_t *dst, size_t *invalid)
+        {
+            const uint8_t *p = reinterpret_cast<const uint8_t *>(src), *end = p + size;
+            char16_t *out = dst;
+            size_t dropped = 0;
+
+            while(p < end)
+            {
+#ifdef BATANG_UTF_SSE2
+                while(end - p >= 16)
+                {
+                    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+                    if(_mm_movemask_epi8(bytes) != 0)
+                        break;
+
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_unpacklo_epi8(bytes, _mm_setzero_si128()));
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 8), _mm_unpackhi_epi8(bytes, _mm_setzero_si128()));
+                    p += 16;
+                    out += 16;
+                }
+#endif
+
+                while(p < end)
+                {
+                    uint32_t lead = *p;
+                    if(lead < 0x80)
+                    {
+                        *out ++ = static_cast<char16_t>(lead);
+                        if(++ p < end && *p < 0x80)
+                            break; // back to the vector path
+                        continue;
+                    }
+
+                    // well-formed two and three byte sequences, which are most of non-ASCII text, go straight through
+                    if(lead >= 0xC2 && lead <= 0xDF && end - p >= 2 && (p[1] & 0xC0) == 0x80)
+                    {
+                        *out ++ = static_cast<char16_t>(((lead & 0x1F) << 6) | (p[1] & 0x3F));
+                        p += 2;
+                        continue;
+                    }
+                    if((lead & 0xF0) == 0xE0 && end - p >= 3 && ((p[1] & 0xC0) | ((p[2] & 0xC0) >> 2)) == 0xA0)
+                    {
+                        uint32_t ch = ((lead & 0x0F) << 12) | ((p[1] & 0x3F) << 6) | (p[2] & 0x3F);
+                        if(ch >= 0x800 && ch - 0xD800 >= 0x800)
+                        {
+                            *out ++ = static_cast<char16_t>(ch);
+                            p += 3;
+                            continue;
+                        }
+                    }
+
+                    size_t length;
+                    uint32_t ch;
+                    if(lead >= 0xC2 && lead <= 0xDF)
+                    {
+                        length = 2;
+                        ch = lead & 0x1F;
+                    }
+                    else if(lead >= 0xE0 && lead <= 0xEF)
+                    {
+                        length = 3;
+                        ch = lead & 0x0F;
+                    }
+                    else if(lead >= 0xF0 && lead <= 0xF4)
+                    {
+                        length = 4;
+                        ch = lead & 0x07;
+                    }
+                    else // stray continuation byte or a lead which can only start an overlong/out-of-range sequence
+                    {
+                        ++ p;
+                        ++ dropped;
+                        continue;
+                    }
+
+                    size_t read = 1;
+                    for(; read < length && p + read < end && (p[read] & 0xC0) == 0x80; ++ read)
+                        ch = (ch << 6) | (p[read] & 0x3F);
+                    p += read;
+
+                    if(read < length // truncated; resume at the byte which broke the sequence
+                        || (length == 3 && (ch < 0x800 || ch - 0xD800 < 0x800)) // overlong or surrogate
+                        || (length == 4 && (ch < 0x10000 || ch > 0x10FFFF)))
+                    {
+                        ++ dropped;
+                        continue;
+                    }
+
+                    if(ch < 0x10000)
+                    {
+                        *out ++ = static_cast<char16_t>(ch);
+                    }
+                    else
+                    {
+                        ch -= 0x10000;
+                        *out ++ = static_cast<char16_t>(0xD800 | (ch >> 10));
+                        *out ++ = static_cast<char16_t>(0xDC00 | (ch & 0x3FF));
+                    }
+                }
+            }
+
+            if(invalid)
+                *invalid += dropped;
+            return out - dst;
+        }
+
+        size_t utf16ToUtf32(const char16_t *src, size_t size, char32_t *dst)
+        {
+            char32_t *out = dst;
+            size_t i = 0;
+
+            while(i < size)
+            {
+#ifdef BATANG_UTF_SSE2
+                while(i + 8 <= size)
+                {
+                    __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+                    __m128i surrogate = _mm_cmpeq_epi16(
+                        _mm_and_si128(units, _mm_set1_epi16(static_cast<short>(0xF800))), _mm_set1_epi16(static_cast<short>(0xD800)));
+                    if(_mm_movemask_epi8(surrogate) != 0)
+                        break;
+
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_unpacklo_epi16(units, _mm_setzero_si128()));
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 4), _mm_unpackhi_epi16(units, _mm_setzero_si128()));
+                    i += 8;
+                    out += 8;
+                }
+#endif
+
+                for(; i < size; ++ i)
+                {
+                    uint32_t ch = src[i];
+                    if(ch - 0xD800 >= 0x800)
+                    {
+                        *out ++ = ch;
+                        if(ch < 0x80)
+                        {
+                            ++ i;
+                            break; // back to the vector path
+                        }
+                    }
+                    else if(ch < 0xDC00 && i + 1 < size && static_cast<uint32_t>(src[i + 1]) - 0xDC00 < 0x400)
+                    {
+                        *out ++ = 0x10000 + ((ch - 0xD800) << 10) + (src[++ i] - 0xDC00);
+                    }
+                    // else a lone surrogate; dropped
+                }
+            }
+
+            return out - dst;
+        }
+
+        size_t utf32ToUtf16(const char32_t *src, size_t size, char16_t *dst)
+        {
+            char16_t *out = dst;
+            size_t i = 0;
+
+            while(i < size)
+            {
+#ifdef BATANG_UTF_SSE2
+                while(i + 8 <= size)
+                {
+                    __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+                    __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 4));
+                    if(_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_srli_epi32(_mm_or_si128(lo, hi), 16), _mm_setzero_si128())) != 0xFFFF)
+                        break;
+
+                    // SSE2 has only a signed 32-to-16 pack, so sign-extend the low halves to keep it from saturating
+                    __m128i units = _mm_packs_epi32(
+                        _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16), _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16));
+                    __m128i surrogate = _mm_cmpeq_epi16(
+                        _mm_and_si128(units, _mm_set1_epi16(static_cast<short>(0xF800))), _mm_set1_epi16(static_cast<short>(0xD800)));
+                    if(_mm_movemask_epi8(surrogate) != 0)
+                        break;
+
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), units);
+                    i += 8;
+                    out += 8;
+                }
+#endif
+
+                for(; i < size; ++ i)
+                {
+                    uint32_t ch = src[i];
+                    if(ch < 0x10000)
+                    {
+                        if(ch - 0xD800 < 0x800) // surrogate code points are not characters
+                            continue;
+                        *out ++ = static_cast<char16_t>(ch);
+                        if(ch < 0x80)
+                        {
+                            ++ i;
+                            break; // back to the vector path
+                        }
+                    }
+                    else if(ch <= 0x10FFFF)
+                    {
+                        ch -= 0x10000;
+                        *out ++ = static_cast<char16_t>(0xD800 | (ch >> 10));
+                        *out ++ = static_cast<char16_t>(0xDC00 | (ch & 0x3FF));
+                    }
+                }
+            }
+
+            return out - dst;
+        }
+    }
+}
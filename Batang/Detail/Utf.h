@@ -0,0 +1,17 @@
+#pragma once
+
+namespace Batang
+{
+    namespace Detail
+    {
+        // Transcoding kernels behind encodeUtf8() and friends.
+        // Each writes into dst, which must hold the worst case noted beside it, and returns the number
+        // of units written. Ill-formed input (lone surrogates, overlong, truncated or out-of-range UTF-8
+        // sequences) is dropped, as boost::locale::conv::utf_to_utf did with its default method;
+        // utf8ToUtf16 adds the number of dropped sequences to *invalid if given.
+        size_t utf16ToUtf8(const char16_t *src, size_t size, char *dst); // 3 * size
+        size_t utf8ToUtf16(const char *src, size_t size, char16_t *dst, size_t *invalid = nullptr); // size
+        size_t utf16ToUtf32(const char16_t *src, size_t size, char32_t *dst); // size
+        size_t utf32ToUtf16(const char32_t *src, size_t size, char16_t *dst); // 2 * size
+    }
+}
@@ -0,0 +1,70 @@
+#include "Common.h"
+
+#include "WaitForGraph.h"
+
+#include "../Error.h"
+#include "../Thread.h"
+
+namespace Batang
+{
+    namespace Detail
+    {
+        std::mutex WaitForGraph::mutex_;
+        std::unordered_map<const ThreadTaskPool *, WaitForGraph::Edge> WaitForGraph::edges_;
+
+        void WaitForGraph::enter(const ThreadTaskPool &waiter, const ThreadTaskPool &target, std::function<bool ()> ready)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            std::vector<std::string> cycle(1, waiter.name());
+            bool stale = ready(); // a waiter on the chain is about to wake and break it
+            for(const ThreadTaskPool *node = &target; ; )
+            {
+                if(node == &waiter)
+                {
+                    if(stale)
+                        break;
+                    cycle.push_back(waiter.name());
+                    throw(DeadlockError(std::move(cycle)));
+                }
+
+                auto it = edges_.find(node);
+                if(it == edges_.end())
+                    break;
+
+                cycle.push_back(it->second.waiterName_);
+                stale = stale || it->second.ready_();
+                node = it->second.target_;
+            }
+
+            Edge edge = { &target, waiter.name(), std::move(ready) };
+            edges_[&waiter] = std::move(edge);
+        }
+
+        void WaitForGraph::leave(const ThreadTaskPool &waiter)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            edges_.erase(&waiter);
+        }
+
+        WaitForGuard::WaitForGuard(const std::weak_ptr<ThreadTaskPool> &target, std::function<bool ()> ready)
+        {
+            if(!ThreadTaskPool::deadlockDetection())
+                return;
+
+            auto ltarget = target.lock();
+            auto waiter = ThreadTaskPool::current().lock();
+            if(!ltarget || !waiter)
+                return;
+
+            WaitForGraph::enter(*waiter, *ltarget, std::move(ready));
+            waiter_ = std::move(waiter);
+        }
+
+        WaitForGuard::~WaitForGuard()
+        {
+            if(waiter_)
+                WaitForGraph::leave(*waiter_);
+        }
+    }
+}
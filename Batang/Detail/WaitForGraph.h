@@ -0,0 +1,45 @@
+#pragma once
+
+namespace Batang
+{
+    class ThreadTaskPool;
+
+    namespace Detail
+    {
+        // Wait-for graph of ThreadTaskPools blocking on each other through invoke().
+        // A thread blocks on at most one pool at a time, so every pool has at most one outgoing edge
+        // and a cycle check is a walk along a single chain. An edge stays until its waiter wakes, so one
+        // whose future is ready already is no part of a deadlock.
+        class WaitForGraph final
+        {
+        private:
+            struct Edge
+            {
+                const ThreadTaskPool *target_;
+                std::string waiterName_;
+                std::function<bool ()> ready_;
+            };
+
+        private:
+            static std::mutex mutex_;
+            static std::unordered_map<const ThreadTaskPool *, Edge> edges_;
+
+        public:
+            static void enter(const ThreadTaskPool &waiter, const ThreadTaskPool &target, std::function<bool ()> ready); // throws DeadlockError
+            static void leave(const ThreadTaskPool &waiter);
+        };
+
+        class WaitForGuard final
+        {
+        private:
+            std::shared_ptr<ThreadTaskPool> waiter_;
+
+        public:
+            WaitForGuard(const std::weak_ptr<ThreadTaskPool> &target, std::function<bool ()> ready);
+            ~WaitForGuard();
+
+        private:
+            WaitForGuard(const WaitForGuard &) = delete;
+        };
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+namespace Batang
+{
+    // A value which is read on hot paths from many threads and replaced rarely.
+    // Readers never lock: they pin the slot of the current epoch with a counter and validate the epoch afterwards.
+    // A writer fills the other slot once its old readers have drained, then flips the epoch.
+    template<typename T>
+    class EpochValue final
+    {
+    private:
+        T slots_[2];
+        std::atomic<uint64_t> epoch_;
+        mutable std::atomic<size_t> readers_[2];
+        std::mutex writeMutex_; // writers only
+
+    public:
+        EpochValue()
+            : epoch_(0)
+        {
+            readers_[0] = 0;
+            readers_[1] = 0;
+        }
+
+        explicit EpochValue(T value)
+            : EpochValue()
+        {
+            slots_[0] = std::move(value);
+        }
+
+    private:
+        EpochValue(const EpochValue &) = delete;
+
+    public:
+        template<typename Func>
+        auto read(Func &&fn) const -> decltype(fn(std::declval<const T &>()))
+        {
+            struct Pin
+            {
+                std::atomic<size_t> &readers_;
+                ~Pin() { -- readers_; }
+            };
+
+            while(true)
+            {
+                uint64_t epoch = epoch_.load();
+                size_t slot = static_cast<size_t>(epoch & 1);
+
+                ++ readers_[slot];
+                if(epoch_.load() == epoch)
+                {
+                    Pin pin = { readers_[slot] };
+                    return fn(slots_[slot]);
+                }
+                -- readers_[slot]; // a writer flipped the epoch meanwhile; retry
+            }
+        }
+
+        T load() const
+        {
+            return read([](const T &value) { return value; });
+        }
+
+        void store(T value)
+        {
+            exchange(std::move(value));
+        }
+
+        T exchange(T value)
+        {
+            std::lock_guard<std::mutex> lock(writeMutex_);
+
+            uint64_t epoch = epoch_.load();
+            size_t next = static_cast<size_t>((epoch + 1) & 1);
+
+            // readers of the slot about to be overwritten belong to an epoch older than the current one
+            while(readers_[next] != 0)
+                std::this_thread::yield();
+
+            slots_[next] = std::move(value);
+            epoch_.store(epoch + 1);
+
+            return slots_[epoch & 1]; // copying concurrently with readers is just another read
+        }
+    };
+}
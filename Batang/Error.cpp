@@ -27,4 +27,25 @@ namespace Batang
         , func_(func)
     {
     }
+
+    namespace
+    {
+        std::string describeCycle(const std::vector<std::string> &cycle)
+        {
+            std::string str = "Deadlock detected; invoke would wait forever: ";
+            for(auto it = cycle.begin(); it != cycle.end(); ++ it)
+            {
+                if(it != cycle.begin())
+                    str += " -> ";
+                str += *it;
+            }
+            return str;
+        }
+    }
+
+    DeadlockError::DeadlockError(std::vector<std::string> cycle)
+        : logic_error(describeCycle(cycle))
+        , cycle_(std::move(cycle))
+    {
+    }
 }
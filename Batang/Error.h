@@ -33,4 +33,16 @@ namespace Batang
         friend void Detail::Assert(bool cond, const char *condStr,
             std::string file, uint32_t line, std::string func, std::string message);
     };
+
+    class DeadlockError : public std::logic_error
+    {
+    private:
+        std::vector<std::string> cycle_;
+
+    public:
+        explicit DeadlockError(std::vector<std::string> cycle);
+
+    public:
+        const std::vector<std::string> &Cycle() const { return cycle_; } // names of the pools, the first one repeated at the end
+    };
 }
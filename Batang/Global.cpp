@@ -13,16 +13,153 @@ namespace Batang
 
     GlobalInitializerManager::~GlobalInitializerManager()
     {
-        for(auto it = std::begin(inits_); it != std::end(inits_); ++ it)
-            it->second->uninit();
+        for(auto it = initOrder_.rbegin(); it != initOrder_.rend(); ++ it)
+            (*it)->uninit();
     }
 
     void GlobalInitializerManager::add(std::shared_ptr<Initializer> init)
     {
         std::lock_guard<std::mutex> lg(lock_);
-        if(inits_.find(init->getName()) != inits_.end())
+        std::string name = init->getName();
+        if(inits_.find(name) != inits_.end())
             return;
-        inits_.emplace(init->getName(), std::move(init));
+
+        auto beginAt = std::chrono::steady_clock::now();
         init->init();
+        auto duration = std::chrono::steady_clock::now() - beginAt;
+
+        inits_.emplace(name, init);
+        initOrder_.push_back(init);
+
+        InitializerTiming timing = { std::move(name), std::this_thread::get_id(), duration };
+        timings_.emplace_back(std::move(timing));
+    }
+
+    void GlobalInitializerManager::enqueue(std::shared_ptr<Initializer> init)
+    {
+        std::lock_guard<std::mutex> lg(lock_);
+        std::string name = init->getName();
+        if(inits_.find(name) != inits_.end())
+            return;
+        for(auto &pending: pending_)
+        {
+            if(pending->getName() == name)
+                return;
+        }
+        pending_.emplace_back(std::move(init));
+    }
+
+    void GlobalInitializerManager::initializeAll()
+    {
+        std::lock_guard<std::mutex> initAllLock(initAllLock_);
+
+        std::vector<std::shared_ptr<Initializer>> pending;
+        std::map<std::string, size_t> pendingIndex;
+        {
+            std::lock_guard<std::mutex> lg(lock_);
+            for(size_t i = 0; i < pending_.size(); ++ i)
+                pendingIndex.emplace(pending_[i]->getName(), i);
+
+            // checked while still queued, so a bad dependency leaves every initializer in place
+            for(auto &init: pending_)
+            {
+                for(auto &dep: init->getDependencies())
+                {
+                    if(pendingIndex.find(dep) == pendingIndex.end() && inits_.find(dep) == inits_.end())
+                        throw(std::logic_error("Initializer " + init->getName() + " depends on unknown initializer " + dep));
+                }
+            }
+            pending.swap(pending_);
+        }
+
+        if(pending.empty())
+            return;
+
+        // TaskGraph wants dependencies added first; order pending ones by depth-first search.
+        enum { Unvisited, Visiting, Visited };
+        std::vector<int> states(pending.size(), Unvisited);
+        std::vector<TaskGraph::NodeId> nodeIds(pending.size());
+        TaskGraph graph;
+        auto caller = ThreadTaskPool::current();
+
+        std::function<void (size_t)> visit = [&](size_t index)
+        {
+            if(states[index] == Visited)
+                return;
+            if(states[index] == Visiting)
+                throw(std::logic_error("Initializer dependency cycle at " + pending[index]->getName()));
+            states[index] = Visiting;
+
+            std::vector<TaskGraph::NodeId> deps;
+            for(auto &dep: pending[index]->getDependencies())
+            {
+                auto it = pendingIndex.find(dep);
+                if(it == pendingIndex.end()) // already initialized
+                    continue;
+                visit(it->second);
+                deps.push_back(nodeIds[it->second]);
+            }
+
+            auto init = pending[index];
+            nodeIds[index] = graph.add(
+                init->getName(),
+                [this, init]()
+                {
+                    auto beginAt = std::chrono::steady_clock::now();
+                    init->init();
+                    record(init, std::this_thread::get_id(), std::chrono::steady_clock::now() - beginAt);
+                },
+                deps,
+                init->getAffinity() == InitAffinity::CallerThread ? caller : std::weak_ptr<ThreadTaskPool>());
+            states[index] = Visited;
+        };
+
+        try
+        {
+            for(size_t i = 0; i < pending.size(); ++ i)
+                visit(i);
+        }
+        catch(const std::logic_error &) // a cycle; nothing has run, so queue them again
+        {
+            std::lock_guard<std::mutex> lg(lock_);
+            pending_.insert(pending_.begin(), pending.begin(), pending.end());
+            throw;
+        }
+
+        struct ReportSaver
+        {
+            GlobalInitializerManager &self_;
+            TaskGraph &graph_;
+            ~ReportSaver()
+            {
+                std::lock_guard<std::mutex> lg(self_.lock_);
+                self_.lastReport_ = graph_.report();
+            }
+        } reportSaver = { *this, graph };
+
+        graph.run();
+    }
+
+    std::vector<GlobalInitializerManager::InitializerTiming> GlobalInitializerManager::timings()
+    {
+        std::lock_guard<std::mutex> lg(lock_);
+        return timings_;
+    }
+
+    std::string GlobalInitializerManager::report()
+    {
+        std::lock_guard<std::mutex> lg(lock_);
+        return lastReport_;
+    }
+
+    void GlobalInitializerManager::record(const std::shared_ptr<Initializer> &init, std::thread::id thread, std::chrono::steady_clock::duration duration)
+    {
+        std::lock_guard<std::mutex> lg(lock_);
+        std::string name = init->getName();
+        inits_.emplace(name, init);
+        initOrder_.push_back(init);
+
+        InitializerTiming timing = { std::move(name), thread, duration };
+        timings_.emplace_back(std::move(timing));
     }
 }
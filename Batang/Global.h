@@ -1,11 +1,12 @@
 ﻿#pragma once
 
 #include "Singleton.h"
+#include "TaskGraph.h"
 
 namespace Batang
 {
 #ifdef _WIN32
-    class Win32Environment final : public Singleton<Win32Environment>
+    class Win32Environment final : public Singleton<Win32Environment, DestructPriority::Normal, ExitBehavior::Skip>
     {
     private:
         HINSTANCE inst_; // Main instance
@@ -35,10 +36,19 @@ namespace Batang
             return dllInstances_;
         }
 
-        friend class Singleton<Win32Environment>;
+        friend class Singleton<Win32Environment, DestructPriority::Normal, ExitBehavior::Skip>;
     };
 #endif
 
+    namespace InitAffinity
+    {
+        enum Type
+        {
+            AnyThread, // may run concurrently on a worker
+            CallerThread, // runs on the thread calling GlobalInitializerManager::initializeAll; e.g. COM apartment
+        };
+    }
+
     class Initializer
     {
     public:
@@ -47,6 +57,16 @@ namespace Batang
             return typeid(*this).name();
         }
 
+        virtual std::vector<std::string> getDependencies() const // names of initializers to run before
+        {
+            return std::vector<std::string>();
+        }
+
+        virtual InitAffinity::Type getAffinity() const
+        {
+            return InitAffinity::AnyThread;
+        }
+
         virtual void init() = 0;
         virtual void uninit() = 0;
     };
@@ -56,10 +76,18 @@ namespace Batang
     private:
         std::string name_;
         std::function<void ()> initFn_, uninitFn_;
+        std::vector<std::string> deps_;
+        InitAffinity::Type affinity_;
 
     public:
-        SimpleInitializer(std::string name, std::function<void ()> initFn, std::function<void ()> uninitFn)
+        SimpleInitializer(
+            std::string name,
+            std::function<void ()> initFn,
+            std::function<void ()> uninitFn,
+            std::vector<std::string> deps = std::vector<std::string>(),
+            InitAffinity::Type affinity = InitAffinity::AnyThread)
             : name_(std::move(name)), initFn_(std::move(initFn)), uninitFn_(std::move(uninitFn))
+            , deps_(std::move(deps)), affinity_(affinity)
         {}
 
         virtual std::string getName() const override
@@ -67,6 +95,16 @@ namespace Batang
             return name_;
         }
 
+        virtual std::vector<std::string> getDependencies() const override
+        {
+            return deps_;
+        }
+
+        virtual InitAffinity::Type getAffinity() const override
+        {
+            return affinity_;
+        }
+
         virtual void init() override
         {
             initFn_();
@@ -110,9 +148,22 @@ namespace Batang
 
     class GlobalInitializerManager final : public Batang::Singleton<GlobalInitializerManager>
     {
+    public:
+        struct InitializerTiming
+        {
+            std::string name_;
+            std::thread::id thread_;
+            std::chrono::steady_clock::duration duration_;
+        };
+
     private:
         std::map<std::string, std::shared_ptr<Initializer>> inits_;
+        std::vector<std::shared_ptr<Initializer>> initOrder_; // uninitialized in reverse
+        std::vector<std::shared_ptr<Initializer>> pending_;
+        std::vector<InitializerTiming> timings_;
+        std::string lastReport_;
         std::mutex lock_;
+        std::mutex initAllLock_;
 
     private:
         GlobalInitializerManager()
@@ -123,13 +174,35 @@ namespace Batang
         GlobalInitializerManager(const GlobalInitializerManager &) = delete;
 
     public:
-        void add(std::shared_ptr<Initializer>);
+        void add(std::shared_ptr<Initializer>); // initializes immediately on this thread
         void add(std::string name, std::function<void ()> initFn, std::function<void ()> uninitFn) // using SimpleInitializer
         {
             add(std::shared_ptr<Initializer>(new SimpleInitializer(
                 std::move(name), std::move(initFn), std::move(uninitFn))));
         }
 
+        void enqueue(std::shared_ptr<Initializer>); // deferred until initializeAll
+        void enqueue(
+            std::string name,
+            std::function<void ()> initFn,
+            std::function<void ()> uninitFn,
+            std::vector<std::string> deps = std::vector<std::string>(),
+            InitAffinity::Type affinity = InitAffinity::AnyThread)
+        {
+            enqueue(std::shared_ptr<Initializer>(new SimpleInitializer(
+                std::move(name), std::move(initFn), std::move(uninitFn), std::move(deps), affinity)));
+        }
+
+        // Runs every enqueued initializer; independent ones run concurrently on WorkerPool.
+        // Rethrows the first failure; initializers depending on a failed one are not run.
+        void initializeAll();
+
+        std::vector<InitializerTiming> timings();
+        std::string report(); // TaskGraph report of the last initializeAll
+
+    private:
+        void record(const std::shared_ptr<Initializer> &, std::thread::id, std::chrono::steady_clock::duration);
+
         friend class Batang::Singleton<GlobalInitializerManager>;
     };
 }
@@ -4,17 +4,192 @@
 
 namespace Batang
 {
+    namespace
+    {
+        struct ConstructionFrame
+        {
+            std::chrono::steady_clock::time_point beginAt_;
+            std::chrono::steady_clock::duration children_;
+        };
+
+        // singletons constructed inside a constructor of another one, per thread
+        std::vector<ConstructionFrame> &constructionStack()
+        {
+            static boost::thread_specific_ptr<std::vector<ConstructionFrame>> stack;
+            if(!stack.get())
+                stack.reset(new std::vector<ConstructionFrame>());
+            return *stack;
+        }
+
+        double toMilliseconds(std::chrono::steady_clock::duration duration)
+        {
+            return std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(duration).count();
+        }
+
+        void reportShutdown(const char *mode, size_t flushed, size_t destroyed, size_t skipped, std::chrono::steady_clock::duration duration)
+        {
+            std::ostringstream os;
+            os << std::fixed << std::setprecision(2);
+            os << "Shutdown (" << mode << "): " << flushed << " flushed, " << destroyed << " destroyed, "
+                << skipped << " skipped in " << toMilliseconds(duration) << " ms\n";
+#ifdef _WIN32
+            OutputDebugStringA(os.str().c_str());
+#endif
+        }
+    }
+
+    SingletonManager::ConstructionProbe::ConstructionProbe(const char *name)
+    {
+        auto &manager = SingletonManager::instance();
+        auto now = std::chrono::steady_clock::now();
+
+        SingletonRecord record;
+        record.name_ = name;
+        record.thread_ = std::this_thread::get_id();
+        record.firstTouchAt_ = now - manager.createdAt_;
+        record.construction_ = std::chrono::steady_clock::duration::zero();
+        record.exclusive_ = std::chrono::steady_clock::duration::zero();
+        record.depth_ = constructionStack().size();
+
+        {
+            std::lock_guard<std::mutex> lock(manager.mutex_);
+            record_ = manager.records_.size();
+            manager.records_.emplace_back(std::move(record));
+        }
+
+        ConstructionFrame frame = { now, std::chrono::steady_clock::duration::zero() };
+        constructionStack().push_back(frame);
+    }
+
+    SingletonManager::ConstructionProbe::~ConstructionProbe()
+    {
+        auto &manager = SingletonManager::instance();
+        auto &stack = constructionStack();
+        auto frame = stack.back();
+        stack.pop_back();
+
+        auto construction = std::chrono::steady_clock::now() - frame.beginAt_;
+        if(!stack.empty())
+            stack.back().children_ += construction;
+
+        std::lock_guard<std::mutex> lock(manager.mutex_);
+        auto &record = manager.records_[record_];
+        record.construction_ = construction;
+        record.exclusive_ = construction - frame.children_;
+    }
+
+    SingletonManager::SingletonManager()
+        : createdAt_(std::chrono::steady_clock::now())
+    {
+    }
+
     SingletonManager::~SingletonManager()
     {
+        auto beginAt = std::chrono::steady_clock::now();
+        size_t count = instances_.size();
+
         while(!instances_.empty())
         {
             instances_.erase(instances_.begin()->first);
         }
+
+        reportShutdown("normal", 0, count, 0, std::chrono::steady_clock::now() - beginAt);
+    }
+
+    void SingletonManager::registerInstance(uint32_t destructPriority, uint32_t exitBehavior, std::shared_ptr<void> instance, std::function<void ()> flush)
+    {
+        Instance entry = { std::move(instance), exitBehavior, std::move(flush) };
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        instances_.emplace(destructPriority, std::move(entry));
+    }
+
+    void SingletonManager::fastExit(int exitCode)
+    {
+        auto &manager = instance();
+        auto beginAt = std::chrono::steady_clock::now();
+        size_t flushed = 0, destroyed = 0, skipped = 0;
+
+        // flushes run unlocked; one touching a singleton for the first time registers it under the lock
+        std::vector<std::function<void ()>> flushFunctions;
+        {
+            std::lock_guard<std::mutex> lock(manager.mutex_);
+            for(auto &entry: manager.instances_)
+            {
+                if(entry.second.exitBehavior_ == ExitBehavior::Flush && entry.second.flush_)
+                    flushFunctions.push_back(entry.second.flush_);
+            }
+        }
+        flushed = flushFunctions.size();
+
+        std::vector<std::future<void>> flushes;
+        for(auto &flush: flushFunctions)
+            flushes.push_back(std::async(std::launch::async, flush));
+
+        for(auto &flush: flushes)
+        {
+            try
+            {
+                flush.get();
+            }
+            catch(...) // exiting anyway; one failed flush must not stop the others
+            {
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(manager.mutex_);
+
+        // destroy in priority order; entries are taken out first since destructors may touch singletons
+        std::vector<std::shared_ptr<void>> toDestroy;
+        for(auto it = manager.instances_.begin(); it != manager.instances_.end();)
+        {
+            if(it->second.exitBehavior_ == ExitBehavior::Destroy)
+            {
+                toDestroy.push_back(std::move(it->second.instance_));
+                it = manager.instances_.erase(it);
+            }
+            else
+            {
+                ++ it;
+            }
+        }
+        skipped = manager.instances_.size() - flushed;
+        destroyed = toDestroy.size();
+
+        lock.unlock();
+        for(auto &instance: toDestroy)
+            instance = nullptr;
+
+        reportShutdown("fast", flushed, destroyed, skipped, std::chrono::steady_clock::now() - beginAt);
+
+        std::quick_exit(exitCode);
     }
 
-    void SingletonManager::registerInstance(uint32_t destructPriority, std::shared_ptr<void> instance)
+    std::vector<SingletonManager::SingletonRecord> SingletonManager::records()
     {
-        instances_.emplace(destructPriority, std::move(instance));
+        auto &manager = instance();
+        std::lock_guard<std::mutex> lock(manager.mutex_);
+        return manager.records_;
+    }
+
+    std::string SingletonManager::report()
+    {
+        auto records = SingletonManager::records();
+
+        std::ostringstream os;
+        os << std::fixed << std::setprecision(2);
+        os << "Singletons: " << records.size() << " constructed\n";
+
+        for(auto &record: records)
+        {
+            os << "  " << std::string(record.depth_ * 2, ' ') << record.name_
+                << ": at " << toMilliseconds(record.firstTouchAt_)
+                << " ms, took " << toMilliseconds(record.construction_)
+                << " ms (self " << toMilliseconds(record.exclusive_)
+                << " ms), thread " << record.thread_ << "\n";
+        }
+
+        return os.str();
     }
 
     SingletonManager &SingletonManager::instance()
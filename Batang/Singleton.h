@@ -16,25 +16,100 @@ namespace Batang
         };
     }
 
+    namespace ExitBehavior // what SingletonManager::fastExit does with a singleton
+    {
+        enum
+        {
+            Destroy = 0, // destructed as usual, after flushes
+            Flush, // has durable state; T::flush() is called, then the instance is abandoned
+            Skip, // nothing worth doing on exit; abandoned
+        };
+    }
+
+    namespace Detail
+    {
+        template<typename T, uint32_t Exit>
+        struct SingletonFlusher
+        {
+            static std::function<void ()> make(T *)
+            {
+                return nullptr;
+            }
+        };
+
+        template<typename T>
+        struct SingletonFlusher<T, ExitBehavior::Flush>
+        {
+            static std::function<void ()> make(T *ptr)
+            {
+                return [ptr]() { ptr->flush(); };
+            }
+        };
+    }
+
     class SingletonManager final
     {
+    public:
+        struct SingletonRecord
+        {
+            std::string name_;
+            std::thread::id thread_;
+            std::chrono::steady_clock::duration firstTouchAt_; // relative to the first use of SingletonManager
+            std::chrono::steady_clock::duration construction_; // including singletons constructed inside
+            std::chrono::steady_clock::duration exclusive_; // excluding singletons constructed inside
+            size_t depth_; // nesting level of construction
+        };
+
     private:
-        std::multimap<uint32_t, std::shared_ptr<void>, std::greater<uint32_t>> instances_;
+        class ConstructionProbe final
+        {
+        private:
+            size_t record_;
+
+        public:
+            explicit ConstructionProbe(const char *name);
+            ~ConstructionProbe();
+
+        private:
+            ConstructionProbe(const ConstructionProbe &) = delete;
+        };
+
+        struct Instance
+        {
+            std::shared_ptr<void> instance_;
+            uint32_t exitBehavior_;
+            std::function<void ()> flush_;
+        };
 
     private:
+        std::multimap<uint32_t, Instance, std::greater<uint32_t>> instances_;
+        std::mutex mutex_; // singletons may be constructed concurrently on different threads
+        std::chrono::steady_clock::time_point createdAt_;
+        std::vector<SingletonRecord> records_;
+
+    private:
+        SingletonManager();
         ~SingletonManager();
 
     private:
-        void registerInstance(uint32_t destructPriority, std::shared_ptr<void> instance);
+        void registerInstance(uint32_t destructPriority, uint32_t exitBehavior, std::shared_ptr<void> instance, std::function<void ()> flush);
+
+    public:
+        static std::vector<SingletonRecord> records(); // in order of first touch
+        static std::string report();
+
+        // Flushes singletons marked ExitBehavior::Flush in parallel, destroys those marked Destroy
+        // and terminates the process with std::quick_exit, leaving everything else on the heap.
+        [[noreturn]] static void fastExit(int exitCode);
 
     private:
         static SingletonManager &instance();
 
-        template<typename, uint32_t>
+        template<typename, uint32_t, uint32_t>
         friend class Singleton;
     };
 
-    template<typename T, uint32_t DestPriority = DestructPriority::Normal>
+    template<typename T, uint32_t DestPriority = DestructPriority::Normal, uint32_t Exit = ExitBehavior::Destroy>
     class Singleton // thread-safe global, boxed with std::shared_ptr, managed by SingletonManager
     {
         // static_assert(sizeof(T) > 0, "T must be complete type.");
@@ -53,8 +128,9 @@ namespace Batang
     protected:
         Singleton()
         {
-            SingletonManager::instance().registerInstance(DestPriority,
-                std::shared_ptr<Singleton>(static_cast<T *>(this), Deleter()));
+            SingletonManager::instance().registerInstance(DestPriority, Exit,
+                std::shared_ptr<Singleton>(static_cast<T *>(this), Deleter()),
+                Detail::SingletonFlusher<T, Exit>::make(static_cast<T *>(this)));
         }
         ~Singleton() {}
 
@@ -62,9 +138,16 @@ namespace Batang
         static T &instance()
         {
             // From VC++ Compiler Nov 2013 CTP, thread-safe static is supported.
-            static T *theInstance = new T();
+            static T *theInstance = construct();
             return *theInstance;
         }
+
+    private:
+        static T *construct()
+        {
+            SingletonManager::ConstructionProbe probe(typeid(T).name());
+            return new T();
+        }
     };
 
     template<typename T>
@@ -0,0 +1,284 @@
+#include "Common.h"
+
+#include "TaskGraph.h"
+
+#include "Error.h"
+#include "WorkerPool.h"
+
+namespace Batang
+{
+    namespace
+    {
+        double toMilliseconds(std::chrono::steady_clock::duration duration)
+        {
+            return std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(duration).count();
+        }
+    }
+
+    TaskGraph::TaskGraph()
+        : elapsed_(0)
+        , finished_(0)
+        , running_(false)
+    {
+    }
+
+    TaskGraph::~TaskGraph()
+    {
+    }
+
+    TaskGraph::NodeId TaskGraph::add(
+        std::string name,
+        std::function<void ()> task,
+        const std::vector<NodeId> &deps,
+        std::weak_ptr<ThreadTaskPool> executor)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        BATANG_ASSERT(!running_, "TaskGraph::add cannot be called while running");
+
+        size_t index = nodes_.size();
+
+        Node node;
+        node.name_ = std::move(name);
+        node.task_ = std::move(task);
+        node.onWorker_ = !executor.lock();
+        node.executor_ = std::move(executor);
+        node.pendingDeps_ = 0;
+        node.skip_ = false;
+        node.failed_ = false;
+
+        for(auto &dep: deps)
+        {
+            // dependencies always precede their dependents, so the graph cannot have a cycle
+            BATANG_ASSERT(dep && *dep - 1 < index, "TaskGraph::add got unknown dependency");
+            node.deps_.push_back(*dep - 1);
+        }
+
+        for(auto dep: node.deps_)
+            nodes_[dep].dependents_.push_back(index);
+
+        nodes_.emplace_back(std::move(node));
+        return NodeId(index + 1);
+    }
+
+    size_t TaskGraph::size() const
+    {
+        return nodes_.size();
+    }
+
+    void TaskGraph::run()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        BATANG_ASSERT(!running_, "TaskGraph::run cannot be nested");
+
+        running_ = true;
+        caller_ = ThreadTaskPool::current().lock();
+        finished_ = 0;
+        error_ = nullptr;
+        callerQueue_.clear();
+        beginAt_ = std::chrono::steady_clock::now();
+
+        for(auto &node: nodes_)
+        {
+            node.pendingDeps_ = node.deps_.size();
+            node.skip_ = false;
+            node.failed_ = false;
+            node.timing_ = NodeTiming();
+            node.timing_.name_ = node.name_;
+        }
+
+        for(size_t i = 0; i < nodes_.size(); ++ i)
+        {
+            if(nodes_[i].pendingDeps_ == 0)
+                dispatch(i);
+        }
+
+        while(finished_ < nodes_.size())
+        {
+            if(!callerQueue_.empty())
+            {
+                size_t index = callerQueue_.front();
+                callerQueue_.pop_front();
+
+                lock.unlock();
+                execute(index);
+                lock.lock();
+                continue;
+            }
+
+            finishedCv_.wait(lock);
+        }
+
+        elapsed_ = std::chrono::steady_clock::now() - beginAt_;
+        markCriticalPath();
+
+        running_ = false;
+        caller_ = nullptr;
+
+        if(error_)
+        {
+            auto error = error_;
+            error_ = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+
+    std::chrono::steady_clock::duration TaskGraph::elapsed() const
+    {
+        return elapsed_;
+    }
+
+    std::vector<TaskGraph::NodeTiming> TaskGraph::timings() const
+    {
+        std::vector<NodeTiming> timings;
+        timings.reserve(nodes_.size());
+        for(auto &node: nodes_)
+            timings.push_back(node.timing_);
+        return timings;
+    }
+
+    std::string TaskGraph::report() const
+    {
+        std::vector<const NodeTiming *> sorted;
+        sorted.reserve(nodes_.size());
+        for(auto &node: nodes_)
+            sorted.push_back(&node.timing_);
+        std::stable_sort(sorted.begin(), sorted.end(), [](const NodeTiming *lhs, const NodeTiming *rhs)
+        {
+            return lhs->startAt_ < rhs->startAt_;
+        });
+
+        std::ostringstream os;
+        os << std::fixed << std::setprecision(2);
+        os << "TaskGraph: " << nodes_.size() << " nodes in " << toMilliseconds(elapsed_) << " ms"
+            << " (* marks the critical path)\n";
+
+        for(auto timing: sorted)
+        {
+            os << (timing->critical_ ? "  * " : "    ");
+            os << timing->name_;
+            if(!timing->executed_)
+            {
+                os << ": skipped\n";
+                continue;
+            }
+            os << ": ready " << toMilliseconds(timing->readyAt_)
+                << " ms, wait " << toMilliseconds(timing->startAt_ - timing->readyAt_)
+                << " ms, run " << toMilliseconds(timing->endAt_ - timing->startAt_)
+                << " ms, thread " << timing->thread_ << "\n";
+        }
+
+        return os.str();
+    }
+
+    void TaskGraph::dispatch(size_t index) // mutex_ must be locked
+    {
+        Node &node = nodes_[index];
+        node.timing_.readyAt_ = std::chrono::steady_clock::now() - beginAt_;
+
+        if(node.skip_)
+        {
+            callerQueue_.push_back(index); // nothing to run; just let the caller account for it
+            finishedCv_.notify_one();
+            return;
+        }
+
+        if(node.onWorker_)
+        {
+            WorkerPool::instance().post([this, index]() { execute(index); });
+            return;
+        }
+
+        auto executor = node.executor_.lock();
+        if(executor == caller_)
+        {
+            callerQueue_.push_back(index);
+            finishedCv_.notify_one();
+        }
+        else if(executor)
+        {
+            executor->post([this, index]() { execute(index); });
+        }
+        else
+        {
+            node.skip_ = true;
+            if(!error_)
+                error_ = std::make_exception_ptr(std::runtime_error("TaskGraph: executor of " + node.name_ + " has gone"));
+            node.failed_ = true;
+            callerQueue_.push_back(index);
+            finishedCv_.notify_one();
+        }
+    }
+
+    void TaskGraph::execute(size_t index)
+    {
+        Node &node = nodes_[index];
+
+        if(!node.skip_)
+        {
+            node.timing_.thread_ = std::this_thread::get_id();
+            node.timing_.startAt_ = std::chrono::steady_clock::now() - beginAt_;
+
+            try
+            {
+                node.task_();
+            }
+            catch(...)
+            {
+                node.failed_ = true;
+
+                std::lock_guard<std::mutex> lock(mutex_);
+                if(!error_)
+                    error_ = std::current_exception();
+            }
+
+            node.timing_.endAt_ = std::chrono::steady_clock::now() - beginAt_;
+            node.timing_.executed_ = true;
+        }
+
+        complete(index);
+    }
+
+    void TaskGraph::complete(size_t index)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        Node &node = nodes_[index];
+        ++ finished_;
+
+        for(auto dependent: node.dependents_)
+        {
+            Node &next = nodes_[dependent];
+            if(node.skip_ || node.failed_)
+                next.skip_ = true;
+            if(-- next.pendingDeps_ == 0)
+                dispatch(dependent);
+        }
+
+        // notify under the lock; run() may return and destroy this graph as soon as it is released
+        finishedCv_.notify_all();
+    }
+
+    void TaskGraph::markCriticalPath()
+    {
+        // walk back from the node finishing last, always following the dependency which finished last
+        size_t last = nodes_.size();
+        for(size_t i = 0; i < nodes_.size(); ++ i)
+        {
+            if(nodes_[i].timing_.executed_ && (last == nodes_.size() || nodes_[last].timing_.endAt_ < nodes_[i].timing_.endAt_))
+                last = i;
+        }
+
+        while(last != nodes_.size())
+        {
+            Node &node = nodes_[last];
+            node.timing_.critical_ = true;
+
+            last = nodes_.size();
+            for(auto dep: node.deps_)
+            {
+                if(nodes_[dep].timing_.executed_ && (last == nodes_.size() || nodes_[last].timing_.endAt_ < nodes_[dep].timing_.endAt_))
+                    last = dep;
+            }
+        }
+    }
+}
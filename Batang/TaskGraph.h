@@ -0,0 +1,83 @@
+#pragma once
+
+#include "Thread.h"
+#include "Wrapper.h"
+
+namespace Batang
+{
+    // DAG of tasks; a node is dispatched once all of its dependencies have finished.
+    // Nodes without an executor run on WorkerPool. Nodes targeting the thread which calls run() are
+    // executed inline by run() itself, so the caller never deadlocks on its own queue.
+    class TaskGraph final
+    {
+    public:
+        struct NodeIdTag {};
+        typedef ValueWrapper<size_t, NodeIdTag, 0> NodeId;
+
+        struct NodeTiming
+        {
+            std::string name_;
+            std::thread::id thread_;
+            std::chrono::steady_clock::duration readyAt_; // relative to the beginning of run()
+            std::chrono::steady_clock::duration startAt_;
+            std::chrono::steady_clock::duration endAt_;
+            bool executed_; // false if skipped because a dependency failed
+            bool critical_; // on the critical path
+        };
+
+    private:
+        struct Node
+        {
+            std::string name_;
+            std::function<void ()> task_;
+            std::vector<size_t> deps_;
+            std::vector<size_t> dependents_;
+            std::weak_ptr<ThreadTaskPool> executor_;
+            bool onWorker_;
+
+            // states of the current run
+            size_t pendingDeps_;
+            bool skip_;
+            bool failed_;
+            NodeTiming timing_;
+        };
+
+    private:
+        std::vector<Node> nodes_;
+        std::mutex mutex_;
+        std::condition_variable finishedCv_;
+        std::deque<size_t> callerQueue_;
+        std::shared_ptr<ThreadTaskPool> caller_;
+        std::chrono::steady_clock::time_point beginAt_;
+        std::chrono::steady_clock::duration elapsed_;
+        size_t finished_;
+        std::exception_ptr error_;
+        bool running_;
+
+    public:
+        TaskGraph();
+        ~TaskGraph();
+
+    private:
+        TaskGraph(const TaskGraph &) = delete;
+
+    public:
+        NodeId add(
+            std::string name,
+            std::function<void ()> task,
+            const std::vector<NodeId> &deps = std::vector<NodeId>(),
+            std::weak_ptr<ThreadTaskPool> executor = std::weak_ptr<ThreadTaskPool>());
+        size_t size() const;
+        void run(); // blocks until every node finished; rethrows the first failure
+
+        std::chrono::steady_clock::duration elapsed() const;
+        std::vector<NodeTiming> timings() const; // in order of addition
+        std::string report() const;
+
+    private:
+        void dispatch(size_t);
+        void execute(size_t);
+        void complete(size_t);
+        void markCriticalPath();
+    };
+}
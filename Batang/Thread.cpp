@@ -8,12 +8,32 @@ namespace Batang
 {
     boost::thread_specific_ptr<std::weak_ptr<ThreadTaskPool>> ThreadTaskPool::currentTaskPool_;
     boost::thread_specific_ptr<std::shared_ptr<ThreadTaskPool>> ThreadTaskPool::emptyThread_;
+#ifdef NDEBUG
+    std::atomic<bool> ThreadTaskPool::deadlockDetection_(false);
+#else
+    std::atomic<bool> ThreadTaskPool::deadlockDetection_(true);
+#endif
 
     namespace
     {
         class EmptyThread : public Thread<EmptyThread>
         {
+        private:
+            std::thread::id id_;
+
+        public:
+            EmptyThread()
+                : id_(std::this_thread::get_id())
+            {}
+
         public:
+            virtual std::string name() const override
+            {
+                std::ostringstream os;
+                os << "thread " << id_;
+                return os.str();
+            }
+
             void run() {}
         };
     }
@@ -37,6 +57,16 @@ namespace Batang
         currentTaskPool_.reset(new std::weak_ptr<ThreadTaskPool>(std::move(current)));
     }
 
+    bool ThreadTaskPool::deadlockDetection()
+    {
+        return deadlockDetection_;
+    }
+
+    void ThreadTaskPool::deadlockDetection(bool enable)
+    {
+        deadlockDetection_ = enable;
+    }
+
     ThreadTaskPool::ThreadTaskPool()
     {
     }
@@ -46,6 +76,11 @@ namespace Batang
         Timer::instance().uninstallAllThreadTimers(*this);
     }
 
+    std::string ThreadTaskPool::name() const
+    {
+        return typeid(*this).name();
+    }
+
     void ThreadTaskPool::post(std::function<void ()> task)
     {
         post(std::unique_ptr<Detail::Task>(new Detail::PostTask(task)));
@@ -3,14 +3,80 @@
 #include "Event.h"
 
 #include "Detail/Task.h"
+#include "Detail/WaitForGraph.h"
 
 namespace Batang
 {
+    template<typename T>
+    class InvokeFuture final // std::future which reports waits to the wait-for graph
+    {
+    private:
+        std::future<T> future_;
+        std::weak_ptr<ThreadTaskPool> target_;
+
+    public:
+        InvokeFuture() {}
+        InvokeFuture(std::future<T> future, std::weak_ptr<ThreadTaskPool> target)
+            : future_(std::move(future))
+            , target_(std::move(target))
+        {}
+        InvokeFuture(InvokeFuture &&rhs)
+            : future_(std::move(rhs.future_))
+            , target_(std::move(rhs.target_))
+        {}
+
+    private:
+        InvokeFuture(const InvokeFuture &) = delete;
+
+    public:
+        InvokeFuture &operator =(InvokeFuture &&rhs)
+        {
+            future_ = std::move(rhs.future_);
+            target_ = std::move(rhs.target_);
+            return *this;
+        }
+
+    public:
+        bool valid() const
+        {
+            return future_.valid();
+        }
+
+        T get()
+        {
+            wait();
+            return future_.get();
+        }
+
+        void wait() const
+        {
+            if(future_.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+                return;
+
+            Detail::WaitForGuard guard(target_, [this]() { return future_.wait_for(std::chrono::seconds(0)) == std::future_status::ready; });
+            future_.wait();
+        }
+
+        // timed waits give up by themselves, so they are not tracked
+        template<typename Rep, typename Period>
+        std::future_status wait_for(const std::chrono::duration<Rep, Period> &duration) const
+        {
+            return future_.wait_for(duration);
+        }
+
+        template<typename Clock, typename Duration>
+        std::future_status wait_until(const std::chrono::time_point<Clock, Duration> &time) const
+        {
+            return future_.wait_until(time);
+        }
+    };
+
     class ThreadTaskPool
     {
     private:
         static boost::thread_specific_ptr<std::weak_ptr<ThreadTaskPool>> currentTaskPool_;
         static boost::thread_specific_ptr<std::shared_ptr<ThreadTaskPool>> emptyThread_;
+        static std::atomic<bool> deadlockDetection_;
 
     private:
         Detail::TaskPool taskPool_;
@@ -20,6 +86,8 @@ namespace Batang
 
     public:
         static const std::weak_ptr<ThreadTaskPool> &current();
+        static bool deadlockDetection();
+        static void deadlockDetection(bool); // track invoke waits and throw DeadlockError instead of hanging
 
     protected:
         static void current(std::weak_ptr<ThreadTaskPool>);
@@ -33,8 +101,9 @@ namespace Batang
 
     public:
         virtual std::shared_ptr<ThreadTaskPool> sharedFromThis() = 0;
+        virtual std::string name() const;
         template<typename Func>
-        auto invoke(Func &&fn) -> std::future<decltype(fn())>
+        auto invoke(Func &&fn) -> InvokeFuture<decltype(fn())>
         {
             typedef decltype(fn()) ReturnType;
 
@@ -47,7 +116,7 @@ namespace Batang
             auto future = task->future();
 
             post(std::move(task));
-            return future;
+            return InvokeFuture<ReturnType>(std::move(future), sharedFromThis());
         }
         void post(std::function<void ()> task);
 
@@ -12,7 +12,7 @@ namespace Batang
         class TimerThread;
     }
 
-    class Timer final : public Singleton<Timer, DestructPriority::Latest>
+    class Timer final : public Singleton<Timer, DestructPriority::Latest, ExitBehavior::Skip>
     {
     public:
         struct TaskIdTag {};
@@ -76,7 +76,7 @@ namespace Batang
     private:
         void onTimerTick();
 
-        friend class Singleton<Timer, DestructPriority::Latest>;
+        friend class Singleton<Timer, DestructPriority::Latest, ExitBehavior::Skip>;
         friend class Detail::TimerThread;
     };
 }
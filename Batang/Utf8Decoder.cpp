@@ -0,0 +1,100 @@
+#include "Common.h"
+
+#include "Utf8Decoder.h"
+
+#include "Detail/Utf.h"
+
+namespace Batang
+{
+    namespace
+    {
+        // Length of the sequence a byte starts; 0 for ASCII, continuation bytes and invalid leads.
+        inline size_t sequenceLength(char ch)
+        {
+            uint8_t lead = static_cast<uint8_t>(ch);
+            if(lead >= 0xC2 && lead <= 0xDF)
+                return 2;
+            else if(lead >= 0xE0 && lead <= 0xEF)
+                return 3;
+            else if(lead >= 0xF0 && lead <= 0xF4)
+                return 4;
+            return 0;
+        }
+
+        inline bool isContinuation(char ch)
+        {
+            return (static_cast<uint8_t>(ch) & 0xC0) == 0x80;
+        }
+    }
+
+    Utf8Decoder::Utf8Decoder()
+        : pendingSize_(0)
+        , invalidCount_(0)
+    {
+    }
+
+    void Utf8Decoder::decode(const char *data, size_t size, std::wstring &out)
+    {
+        const char *p = data, *end = data + size;
+
+        if(pendingSize_ > 0)
+        {
+            size_t length = sequenceLength(pending_[0]);
+            while(pendingSize_ < length && p != end && isContinuation(*p))
+                pending_[pendingSize_ ++] = *p ++;
+            if(pendingSize_ < length && p == end)
+                return;
+
+            // complete, or broken by a byte which cannot continue it; the kernel tells which
+            size_t base = out.size();
+            out.resize(base + pendingSize_);
+            out.resize(base + Detail::utf8ToUtf16(pending_, pendingSize_, reinterpret_cast<char16_t *>(&out[0] + base), &invalidCount_));
+            pendingSize_ = 0;
+        }
+
+        // hold back a sequence cut by the end of this chunk
+        const char *tail = end;
+        for(size_t back = 1; back <= std::min<size_t>(3, end - p); ++ back)
+        {
+            if(!isContinuation(end[-static_cast<ptrdiff_t>(back)]))
+            {
+                if(sequenceLength(end[-static_cast<ptrdiff_t>(back)]) > back)
+                    tail = end - back;
+                break;
+            }
+        }
+
+        size_t base = out.size();
+        out.resize(base + (tail - p));
+        out.resize(base + Detail::utf8ToUtf16(p, tail - p, reinterpret_cast<char16_t *>(&out[0] + base), &invalidCount_));
+
+        pendingSize_ = end - tail;
+        std::copy(tail, end, pending_);
+    }
+
+    bool Utf8Decoder::finish()
+    {
+        bool complete = pendingSize_ == 0;
+        if(!complete)
+            ++ invalidCount_;
+
+        pendingSize_ = 0;
+        return complete;
+    }
+
+    void Utf8Decoder::reset()
+    {
+        pendingSize_ = 0;
+        invalidCount_ = 0;
+    }
+
+    size_t Utf8Decoder::pendingSize() const
+    {
+        return pendingSize_;
+    }
+
+    size_t Utf8Decoder::invalidCount() const
+    {
+        return invalidCount_;
+    }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+namespace Batang
+{
+    // Resumable UTF-8 decoder for input arriving in arbitrary chunks, e.g. from a socket.
+    // A sequence cut at the end of a chunk is held back until the next chunk completes it.
+    // Ill-formed sequences are dropped like decodeUtf8() does, and counted.
+    class Utf8Decoder
+    {
+    private:
+        char pending_[4];
+        size_t pendingSize_;
+        size_t invalidCount_;
+
+    public:
+        Utf8Decoder();
+
+    public:
+        void decode(const char *, size_t, std::wstring &); // appends to the last argument
+        bool finish(); // drops a sequence left unfinished and resets; false if there was one
+        void reset();
+
+        size_t pendingSize() const; // bytes held back for the next chunk
+        size_t invalidCount() const; // sequences dropped since construction or the last reset()
+    };
+}
@@ -2,60 +2,121 @@
 
 #include "Utility.h"
 
+#include "Base64.h"
+
+#include "Detail/Utf.h"
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define BATANG_UTILITY_SSE2
+#include <emmintrin.h>
+#endif
+
 namespace Batang
 {
-    std::wstring trim(std::wstring str)
+    namespace
     {
-        static auto fn = [](wchar_t ch) -> wchar_t { return ch != L' ' && ch != L'　' && ch != L'\t' && ch != L'\n' && ch != L'\r'; };
-        str.erase(str.begin(), find_if(str.begin(), str.end(), fn));
-        str.erase(find_if(str.rbegin(), str.rend(), fn).base(), str.end());
-        return str;
-    }
+        inline bool isSpace(wchar_t ch)
+        {
+            return ch == L' ' || ch == L'　' || ch == L'\t' || ch == L'\n' || ch == L'\r';
+        }
 
-    std::vector<std::wstring> split(const std::wstring &str, const std::wstring &sep)
-    {
-        size_t ppos, pos = static_cast<size_t>(-static_cast<ptrdiff_t>(sep.size()));
-        std::vector<std::wstring> ve;
+        inline bool isSpace(char ch)
+        {
+            return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+        }
 
-        while(true)
+        template<typename CharT>
+        boost::basic_string_view<CharT> trimSpaces(boost::basic_string_view<CharT> str)
         {
-            ppos = pos + sep.size();
-            pos = str.find(sep, ppos);
+            while(!str.empty() && isSpace(str.front()))
+                str.remove_prefix(1);
+            while(!str.empty() && isSpace(str.back()))
+                str.remove_suffix(1);
+            return str;
+        }
 
-            if(pos == std::wstring::npos)
+        template<typename String, typename Pieces, typename Separator>
+        String joinPieces(const Pieces &ve, const Separator &sep)
+        {
+            String str;
+            if(ve.empty())
+                return str;
+
+            size_t size = sep.size() * (ve.size() - 1);
+            for(auto &piece: ve)
+                size += piece.size();
+            str.reserve(size);
+
+            str.append(ve.front().begin(), ve.front().end());
+            for(auto it = ++ ve.begin(); it != ve.end(); ++ it)
             {
-                ve.push_back(str.substr(ppos));
-                break;
+                str.append(sep.begin(), sep.end());
+                str.append(it->begin(), it->end());
             }
-            else
-                ve.push_back(str.substr(ppos, pos - ppos));
+
+            return str;
         }
+    }
 
-        return ve;
+    boost::wstring_view trimView(boost::wstring_view str)
+    {
+        return trimSpaces(str);
     }
 
-    std::vector<std::wstring> splitAnyOf(const std::wstring &str, const std::wstring &sep)
+    boost::string_view trimView(boost::string_view str)
     {
-        std::vector<std::wstring> result;
-        boost::algorithm::split(result, str, boost::algorithm::is_any_of(sep));
-        return result;
+        return trimSpaces(str);
     }
 
-    std::wstring join(const std::vector<std::wstring> &ve, const std::wstring &sep)
+    SplitRange<wchar_t> splitView(boost::wstring_view str, boost::wstring_view sep)
     {
-        if(ve.empty())
-            return std::wstring();
+        return SplitRange<wchar_t>(str, sep, false);
+    }
 
-        std::wstring str = ve.front();
-        for(auto it = ++ ve.begin(); it != ve.end(); ++ it)
-        {
-            str += sep;
-            str += *it;
-        }
+    SplitRange<char> splitView(boost::string_view str, boost::string_view sep)
+    {
+        return SplitRange<char>(str, sep, false);
+    }
 
+    SplitRange<wchar_t> splitAnyOfView(boost::wstring_view str, boost::wstring_view sep)
+    {
+        return SplitRange<wchar_t>(str, sep, true);
+    }
+
+    SplitRange<char> splitAnyOfView(boost::string_view str, boost::string_view sep)
+    {
+        return SplitRange<char>(str, sep, true);
+    }
+
+    std::wstring trim(std::wstring str)
+    {
+        auto view = trimView(boost::wstring_view(str));
+        size_t begin = view.data() - str.data();
+        str.erase(begin + view.size());
+        str.erase(0, begin);
         return str;
     }
 
+    std::vector<std::wstring> split(const std::wstring &str, const std::wstring &sep)
+    {
+        return splitView(str, sep).toVector();
+    }
+
+    std::vector<std::wstring> splitAnyOf(const std::wstring &str, const std::wstring &sep)
+    {
+        return splitAnyOfView(str, sep).toVector();
+    }
+
+    std::wstring join(const std::vector<std::wstring> &ve, const std::wstring &sep)
+    {
+        return joinPieces<std::wstring>(ve, sep);
+    }
+
+    std::wstring join(const std::vector<boost::wstring_view> &ve, boost::wstring_view sep)
+    {
+        return joinPieces<std::wstring>(ve, sep);
+    }
+
     std::wstring getDirectoryPath(std::wstring path)
     {
         size_t pos = path.rfind(L'\\');
@@ -64,201 +125,260 @@ namespace Batang
         return path;
     }
 
+    static_assert(sizeof(wchar_t) == sizeof(char16_t), "wchar_t is expected to hold UTF-16");
+
     std::string encodeUtf8(const std::wstring &str)
     {
-        return boost::locale::conv::utf_to_utf<char>(str);
+        std::string result;
+        encodeUtf8(str.data(), str.size(), result);
+        return result;
     }
 
     std::wstring decodeUtf8(const std::string &str)
     {
-        return boost::locale::conv::utf_to_utf<wchar_t>(str);
+        std::wstring result;
+        decodeUtf8(str.data(), str.size(), result);
+        return result;
     }
 
     std::u32string encodeUtf32(const std::wstring &str)
     {
-        return boost::locale::conv::utf_to_utf<char32_t>(str);
+        std::u32string result;
+        encodeUtf32(str.data(), str.size(), result);
+        return result;
     }
 
     std::wstring decodeUtf32(const std::u32string &str)
     {
-        return boost::locale::conv::utf_to_utf<wchar_t>(str);
+        std::wstring result;
+        decodeUtf32(str.data(), str.size(), result);
+        return result;
     }
 
-    std::string base64Encode(const std::vector<uint8_t> &data)
+    // Each grows the buffer to the worst case first and trims it back to what the transcoder has written.
+
+    void encodeUtf8(const wchar_t *str, size_t size, std::string &out)
     {
-        static const char hashChar[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-        static const char padding = '=';
+        size_t base = out.size();
+        out.resize(base + size * 3);
+        out.resize(base + Detail::utf16ToUtf8(reinterpret_cast<const char16_t *>(str), size, &out[0] + base));
+    }
 
-        std::string str;
-        str.reserve((data.size() + 2) * 4 / 3);
-        uint8_t buf[3];
-        char cand[4];
-        size_t i = 0;
+    void decodeUtf8(const char *str, size_t size, std::wstring &out)
+    {
+        size_t base = out.size();
+        out.resize(base + size);
+        out.resize(base + Detail::utf8ToUtf16(str, size, reinterpret_cast<char16_t *>(&out[0] + base)));
+    }
 
-        for(auto it = data.begin(), ed = data.end(); it != ed; ++ it)
-        {
-            buf[i ++] = *it;
-            if(i >= 3)
-            {
-                cand[0] = hashChar[(buf[0] & 0xFC) >> 2];
-                cand[1] = hashChar[((buf[0] & 0x03) << 4) | ((buf[1] & 0xF0) >> 4)];
-                cand[2] = hashChar[((buf[1] & 0x0F) << 2) | ((buf[2] & 0xC0) >> 6)];
-                cand[3] = hashChar[buf[2] & 0x3F];
-                str.insert(str.end(), cand, cand + 4);
-                i = 0;
-            }
-        }
+    void encodeUtf32(const wchar_t *str, size_t size, std::u32string &out)
+    {
+        size_t base = out.size();
+        out.resize(base + size);
+        out.resize(base + Detail::utf16ToUtf32(reinterpret_cast<const char16_t *>(str), size, &out[0] + base));
+    }
 
-        if(i > 0)
-        {
-            size_t j;
-            for(j = i; j < 3; ++ j)
-                buf[j] = 0;
-            cand[0] = hashChar[(buf[0] & 0xFC) >> 2];
-            cand[1] = hashChar[((buf[0] & 0x03) << 4) | ((buf[1] & 0xF0) >> 4)];
-            cand[2] = hashChar[((buf[1] & 0x0F) << 2) | ((buf[2] & 0xC0) >> 6)];
-            cand[3] = hashChar[buf[2] & 0x3F];
-            str.insert(str.end(), cand, cand + (i + 1));
-            while(++ i <= 3)
-                str.push_back('=');
-        }
+    void decodeUtf32(const char32_t *str, size_t size, std::wstring &out)
+    {
+        size_t base = out.size();
+        out.resize(base + size * 2);
+        out.resize(base + Detail::utf32ToUtf16(str, size, reinterpret_cast<char16_t *>(&out[0] + base)));
+    }
 
-        return str;
+    std::string base64Encode(const std::vector<uint8_t> &data)
+    {
+        return base64Encode(data.data(), data.size());
     }
 
-    namespace
+    std::string base64Encode(const void *data, size_t size)
     {
-        inline bool isBase64(char ch)
-        {
-            return isalnum(ch) || ch == '+' || ch == '/';
-        }
+        std::string str;
+        str.reserve((size + 2) / 3 * 4);
+
+        Base64Encoder encoder;
+        encoder.encode(data, size, str);
+        encoder.finish(str);
+        return str;
     }
 
-    //std::vector<uint8_t> base64Decode(const std::string &str)
-    //{
-    //}
+    std::vector<uint8_t> base64Decode(const std::string &str)
+    {
+        std::vector<uint8_t> data;
+        data.reserve(str.size() / 4 * 3 + 2);
+
+        Base64Decoder decoder;
+        decoder.decode(str.data(), str.size(), data);
+        decoder.finish(data);
+        return data;
+    }
 
     namespace
     {
-        char hexDigits[16] =
+        const char hexDigits[16] =
         {
             '0', '1', '2', '3', '4', '5', '6', '7',
             '8', '9', 'A', 'B', 'C', 'D', 'E', 'F',
         };
 
-        int hexDigitToNum(char ch)
+        struct UrlCharTable
         {
-            if(ch >= '0' && ch <= '9')
-                return ch - '0';
-            else if(ch >= 'A' && ch <= 'F')
-                return ch - 'A' + 10;
-            else if(ch >= 'a' && ch <= 'f')
-                return ch - 'a' + 10;
-            return -1;
+            bool unreserved_[256]; // RFC 3986 section 2.3
+            int8_t hexValues_[256]; // -1 for non-hex digits
+
+            UrlCharTable()
+            {
+                for(int i = 0; i < 256; ++ i)
+                {
+                    unreserved_[i] = (i >= '0' && i <= '9') || (i >= 'A' && i <= 'Z') || (i >= 'a' && i <= 'z')
+                        || i == '-' || i == '.' || i == '_' || i == '~';
+
+                    if(i >= '0' && i <= '9')
+                        hexValues_[i] = static_cast<int8_t>(i - '0');
+                    else if(i >= 'A' && i <= 'F')
+                        hexValues_[i] = static_cast<int8_t>(i - 'A' + 10);
+                    else if(i >= 'a' && i <= 'f')
+                        hexValues_[i] = static_cast<int8_t>(i - 'a' + 10);
+                    else
+                        hexValues_[i] = -1;
+                }
+            }
+        };
+
+        const UrlCharTable urlCharTable;
+
+#ifdef BATANG_UTILITY_SSE2
+        inline uint32_t countTrailingZeros(uint32_t value)
+        {
+#ifdef _MSC_VER
+            unsigned long index;
+            _BitScanForward(&index, value);
+            return index;
+#else
+            return __builtin_ctz(value);
+#endif
         }
 
-        inline bool isSafeURIChar(char ch)
+        inline __m128i inRange(__m128i bytes, char low, char high) // signed, so bytes above 0x7F never match
         {
-            return (ch >= '0' && ch <= '9') // <DIGIT>
-                || (ch >= 'A' && ch <= 'Z') // <UPPER>
-                || (ch >= 'a' && ch <= 'z') // <LOWER>
-                || (ch == '$' || ch == '-' || ch == '_' || ch == '@' || ch == '.' || ch == '~') // <SAFE>
-                || (ch == '!' || ch == '*' || ch == '"' || ch == '\'' || ch == ','
-                    || ch == '(' || ch == ')' || ch == '[' || ch == ']'); // <EXTRA>
+            return _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8(low - 1)), _mm_cmplt_epi8(bytes, _mm_set1_epi8(high + 1)));
         }
-    }
+#endif
 
-    std::string encodeUrl(const std::string &str)
-    {
-        std::string buf;
-        buf.reserve(str.size());
-        for(auto it = str.begin(); it != str.end(); ++ it)
+        // Length of the leading run which encodes to itself.
+        size_t unreservedRun(const char *begin, const char *end)
         {
-            if(isSafeURIChar(*it))
-                buf.push_back(*it);
-            else
+            const char *p = begin;
+
+#ifdef BATANG_UTILITY_SSE2
+            for(; end - p >= 16; p += 16)
+            {
+                __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+                __m128i safe = _mm_or_si128(
+                    inRange(_mm_or_si128(bytes, _mm_set1_epi8(0x20)), 'a', 'z'), // either case
+                    inRange(bytes, '0', '9'));
+                safe = _mm_or_si128(safe, _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('-')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('.'))),
+                    _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('_')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('~')))));
+
+                uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(safe));
+                if(mask != 0xFFFF)
+                    return p - begin + countTrailingZeros(~mask);
+            }
+#endif
+
+            while(p != end && urlCharTable.unreserved_[static_cast<uint8_t>(*p)])
+                ++ p;
+            return p - begin;
+        }
+
+        void escapeUrl(boost::string_view str, std::string &out, bool spaceAsPlus)
+        {
+            const char *p = str.data(), *end = p + str.size();
+            out.reserve(out.size() + str.size());
+
+            while(p != end)
             {
-                buf += "%";
-                buf.push_back(hexDigits[*it >> 4]);
-                buf.push_back(hexDigits[*it & 0x0F]);
+                size_t run = unreservedRun(p, end);
+                out.append(p, run);
+                p += run;
+                if(p == end)
+                    break;
+
+                uint8_t ch = static_cast<uint8_t>(*p ++);
+                if(ch == ' ' && spaceAsPlus)
+                {
+                    out.push_back('+');
+                }
+                else
+                {
+                    char escaped[3] = { '%', hexDigits[ch >> 4], hexDigits[ch & 0x0F] };
+                    out.append(escaped, 3);
+                }
             }
         }
+    }
 
+    std::string encodeUrl(boost::string_view str)
+    {
+        std::string buf;
+        escapeUrl(str, buf, false);
         return buf;
     }
 
-    std::string encodeUrlParam(const std::string &str)
+    std::string encodeUrlParam(boost::string_view str)
     {
         std::string buf;
-        buf.reserve(str.size());
-        for(auto it = str.begin(); it != str.end(); ++ it)
-        {
-            if(isSafeURIChar(*it))
-                buf.push_back(*it);
-            else if(*it == ' ')
-                buf += "+";
-            else
-            {
-                buf += "%";
-                buf.push_back(hexDigits[*it >> 4]);
-                buf.push_back(hexDigits[*it & 0x0F]);
-            }
-        }
-            
+        escapeUrl(str, buf, true);
         return buf;
     }
 
-    std::string decodeUrl(const std::string &str)
+    std::string decodeUrl(boost::string_view str)
     {
         std::string buf;
-        char percentFirstChar;
-        int num;
-        enum
-        {
-            NORMAL,
-            IN_PERCENT_FIRST,
-            IN_PERCENT_SECOND
-        } token = NORMAL;
-        for(auto it = str.begin(); it != str.end(); ++ it)
+        decodeUrl(str, buf);
+        return buf;
+    }
+
+    void encodeUrl(boost::string_view str, std::string &out)
+    {
+        escapeUrl(str, out, false);
+    }
+
+    void encodeUrlParam(boost::string_view str, std::string &out)
+    {
+        escapeUrl(str, out, true);
+    }
+
+    void decodeUrl(boost::string_view str, std::string &out)
+    {
+        const char *p = str.data(), *end = p + str.size();
+        out.reserve(out.size() + str.size());
+
+        while(p != end)
         {
-            switch(token)
+            auto percent = static_cast<const char *>(std::memchr(p, '%', end - p));
+            if(!percent)
             {
-            case NORMAL:
-                if(*it == '%')
-                    token = IN_PERCENT_FIRST;
-                else
-                    buf += *it;
+                out.append(p, end);
                 break;
+            }
 
-            case IN_PERCENT_FIRST:
-                if(hexDigitToNum(*it) < 0)
-                {
-                    buf += '%';
-                    buf += *it;
-                    token = NORMAL;
-                }
-                else
-                {
-                    percentFirstChar = *it;
-                    token = IN_PERCENT_SECOND;
-                }
-                break;
+            out.append(p, percent);
+            p = percent + 1;
 
-            case IN_PERCENT_SECOND:
-                num = hexDigitToNum(*it);
-                if(num < 0)
-                {
-                    buf += '%';
-                    buf += percentFirstChar;
-                    buf += *it;
-                }
-                else
-                    buf += static_cast<char>(hexDigitToNum(percentFirstChar) << 4 | num);
-                token = NORMAL;
-                break;
+            // a '%' not followed by two hex digits is kept as it is
+            int high = p != end ? urlCharTable.hexValues_[static_cast<uint8_t>(p[0])] : -1;
+            int low = high >= 0 && end - p >= 2 ? urlCharTable.hexValues_[static_cast<uint8_t>(p[1])] : -1;
+            if(low >= 0)
+            {
+                out.push_back(static_cast<char>((high << 4) | low));
+                p += 2;
+            }
+            else
+            {
+                out.push_back('%');
             }
         }
-        return buf;
     }
 
     float round(float n)
@@ -2,20 +2,167 @@
 
 namespace Batang
 {
+    // Splits a string lazily into views of it, by a separator string or by any character of a set.
+    // Nothing is copied, so the source has to outlive the range and its pieces.
+    template<typename CharT>
+    class SplitRange
+    {
+    public:
+        typedef boost::basic_string_view<CharT> View;
+
+        class Iterator
+        {
+        public:
+            typedef std::forward_iterator_tag iterator_category;
+            typedef View value_type;
+            typedef ptrdiff_t difference_type;
+            typedef const View *pointer;
+            typedef const View &reference;
+
+        private:
+            const SplitRange *range_; // nullptr at the end
+            View piece_;
+            size_t next_; // start of the following piece; npos if piece_ is the last one
+
+        public:
+            Iterator()
+                : range_(nullptr)
+                , next_(View::npos)
+            {
+            }
+
+            explicit Iterator(const SplitRange *range)
+                : range_(range)
+            {
+                find(0);
+            }
+
+        public:
+            const View &operator *() const
+            {
+                return piece_;
+            }
+
+            const View *operator ->() const
+            {
+                return &piece_;
+            }
+
+            Iterator &operator ++()
+            {
+                if(next_ == View::npos)
+                    range_ = nullptr;
+                else
+                    find(next_);
+                return *this;
+            }
+
+            Iterator operator ++(int)
+            {
+                Iterator it = *this;
+                ++ *this;
+                return it;
+            }
+
+            bool operator ==(const Iterator &rhs) const
+            {
+                if(!range_ || !rhs.range_)
+                    return range_ == rhs.range_;
+                return piece_.data() == rhs.piece_.data() && next_ == rhs.next_;
+            }
+
+            bool operator !=(const Iterator &rhs) const
+            {
+                return !(*this == rhs);
+            }
+
+        private:
+            void find(size_t begin)
+            {
+                const View &str = range_->str_, &sep = range_->sep_;
+                size_t pos = View::npos;
+                if(!sep.empty())
+                    pos = range_->anyOf_ ? str.find_first_of(sep, begin) : str.find(sep, begin);
+
+                if(pos == View::npos)
+                {
+                    piece_ = str.substr(begin);
+                    next_ = View::npos;
+                }
+                else
+                {
+                    piece_ = str.substr(begin, pos - begin);
+                    next_ = pos + (range_->anyOf_ ? 1 : sep.size());
+                }
+            }
+        };
+
+        typedef Iterator iterator;
+        typedef Iterator const_iterator;
+
+    private:
+        View str_;
+        View sep_;
+        bool anyOf_;
+
+    public:
+        SplitRange(View str, View sep, bool anyOf)
+            : str_(str)
+            , sep_(sep)
+            , anyOf_(anyOf)
+        {
+        }
+
+    public:
+        Iterator begin() const
+        {
+            return Iterator(this);
+        }
+
+        Iterator end() const
+        {
+            return Iterator();
+        }
+
+        std::vector<std::basic_string<CharT>> toVector() const
+        {
+            std::vector<std::basic_string<CharT>> ve;
+            for(auto &piece: *this)
+                ve.emplace_back(piece.begin(), piece.end());
+            return ve;
+        }
+    };
+
+    boost::wstring_view trimView(boost::wstring_view);
+    boost::string_view trimView(boost::string_view);
+    SplitRange<wchar_t> splitView(boost::wstring_view, boost::wstring_view);
+    SplitRange<char> splitView(boost::string_view, boost::string_view);
+    SplitRange<wchar_t> splitAnyOfView(boost::wstring_view, boost::wstring_view);
+    SplitRange<char> splitAnyOfView(boost::string_view, boost::string_view);
+
     std::wstring trim(std::wstring);
     std::vector<std::wstring> split(const std::wstring &, const std::wstring &);
     std::vector<std::wstring> splitAnyOf(const std::wstring &, const std::wstring &);
     std::wstring join(const std::vector<std::wstring> &, const std::wstring &);
+    std::wstring join(const std::vector<boost::wstring_view> &, boost::wstring_view);
     std::wstring getDirectoryPath(std::wstring);
     std::string encodeUtf8(const std::wstring &);
     std::wstring decodeUtf8(const std::string &);
     std::u32string encodeUtf32(const std::wstring &);
     std::wstring decodeUtf32(const std::u32string &);
+    void encodeUtf8(const wchar_t *, size_t, std::string &); // appends to the last argument
+    void decodeUtf8(const char *, size_t, std::wstring &);
+    void encodeUtf32(const wchar_t *, size_t, std::u32string &);
+    void decodeUtf32(const char32_t *, size_t, std::wstring &);
     std::string base64Encode(const std::vector<uint8_t> &);
-    std::vector<uint8_t> base64Decode(const std::string &);
-    std::string encodeUrl(const std::string &);
-    std::string encodeUrlParam(const std::string &);
-    std::string decodeUrl(const std::string &);
+    std::string base64Encode(const void *, size_t);
+    std::vector<uint8_t> base64Decode(const std::string &); // throws std::runtime_error on malformed input
+    std::string encodeUrl(boost::string_view); // RFC 3986; everything but unreserved characters is escaped
+    std::string encodeUrlParam(boost::string_view); // same, except that a space becomes '+'
+    std::string decodeUrl(boost::string_view);
+    void encodeUrl(boost::string_view, std::string &); // appends to the last argument
+    void encodeUrlParam(boost::string_view, std::string &);
+    void decodeUrl(boost::string_view, std::string &);
 
     float round(float);
     double round(double);
@@ -0,0 +1,64 @@
+#include "Common.h"
+
+#include "WorkerPool.h"
+
+namespace Batang
+{
+    WorkerPool::WorkerPool()
+        : toQuit_(false)
+    {
+        size_t count = std::max(std::thread::hardware_concurrency(), 2u);
+        workers_.reserve(count);
+        for(size_t i = 0; i < count; ++ i)
+            workers_.emplace_back(&WorkerPool::work, this);
+    }
+
+    WorkerPool::~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(taskPoolMutex_);
+            toQuit_ = true;
+        }
+        taskCv_.notify_all();
+
+        for(auto &worker: workers_)
+            worker.join();
+    }
+
+    size_t WorkerPool::size() const
+    {
+        return workers_.size();
+    }
+
+    void WorkerPool::post(std::function<void ()> task)
+    {
+        post(std::unique_ptr<Detail::Task>(new Detail::PostTask(std::move(task))));
+    }
+
+    void WorkerPool::post(std::unique_ptr<Detail::Task> task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(taskPoolMutex_);
+            taskPool_.push(std::move(task));
+        }
+        taskCv_.notify_one();
+    }
+
+    void WorkerPool::work()
+    {
+        while(true)
+        {
+            std::unique_ptr<Detail::Task> task;
+
+            {
+                std::unique_lock<std::mutex> lock(taskPoolMutex_);
+                taskCv_.wait(lock, [this]() { return toQuit_ || !taskPool_.empty(); });
+                if(taskPool_.empty()) // quitting and nothing left
+                    return;
+                task = taskPool_.pop();
+            }
+
+            (*task)();
+        }
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "Singleton.h"
+
+#include "Detail/Task.h"
+
+namespace Batang
+{
+    class WorkerPool final : public Singleton<WorkerPool, DestructPriority::Fastest, ExitBehavior::Skip> // joined before any other singleton dies
+    {
+    private:
+        Detail::TaskPool taskPool_;
+        std::mutex taskPoolMutex_;
+        std::condition_variable taskCv_;
+        std::vector<std::thread> workers_;
+        bool toQuit_;
+
+    private:
+        WorkerPool();
+        ~WorkerPool();
+
+    public:
+        size_t size() const;
+
+        template<typename Func>
+        auto invoke(Func &&fn) -> std::future<decltype(fn())>
+        {
+            typedef decltype(fn()) ReturnType;
+
+            auto task = std::make_unique<Detail::InvokeTask<ReturnType>>(std::forward<Func>(fn));
+            auto future = task->future();
+
+            post(std::move(task));
+            return future;
+        }
+        void post(std::function<void ()> task);
+
+        // Constructs the given singletons on workers ahead of their first use; the futures carry what a constructor threw.
+        template<typename ...Singletons>
+        std::vector<std::future<void>> prewarm()
+        {
+            std::vector<std::future<void>> futures;
+            int expand[] = { 0, (futures.push_back(invoke([]() { Singletons::instance(); })), 0)... };
+            (void)expand;
+            return futures;
+        }
+
+    private:
+        void post(std::unique_ptr<Detail::Task>);
+        void work();
+
+        friend class Singleton<WorkerPool, DestructPriority::Fastest, ExitBehavior::Skip>;
+    };
+}
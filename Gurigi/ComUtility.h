@@ -5,13 +5,13 @@
 
 namespace Gurigi
 {
-    class ComInitializer final : public Batang::Singleton<ComInitializer>
+    class ComInitializer final : public Batang::Singleton<ComInitializer, Batang::DestructPriority::Normal, Batang::ExitBehavior::Skip>
     {
     private:
         ComInitializer();
         ~ComInitializer();
 
-        friend class Batang::Singleton<ComInitializer>;
+        friend class Batang::Singleton<ComInitializer, Batang::DestructPriority::Normal, Batang::ExitBehavior::Skip>;
     };
 
     template<typename Chain>
@@ -9,7 +9,7 @@ namespace Gurigi
 {
     namespace Drawing
     {
-        class D2DFactory final : public Batang::Singleton<D2DFactory>
+        class D2DFactory final : public Batang::Singleton<D2DFactory, Batang::DestructPriority::Normal, Batang::ExitBehavior::Skip>
         {
         private:
             ComPtr<ID2D1Factory> d2dfac_;
@@ -30,7 +30,7 @@ namespace Gurigi
                 return dwfac_;
             }
 
-            friend class Batang::Singleton<D2DFactory>;
+            friend class Batang::Singleton<D2DFactory, Batang::DestructPriority::Normal, Batang::ExitBehavior::Skip>;
         };
 
         class Context final
@@ -74,7 +74,7 @@ namespace Gurigi
             Context &operator =(const Context &) = delete;
         };
 
-        class FontFactory final : public Batang::Singleton<FontFactory>
+        class FontFactory final : public Batang::Singleton<FontFactory, Batang::DestructPriority::Normal, Batang::ExitBehavior::Skip>
         {
         private:
             FontFactory();
@@ -90,7 +90,7 @@ namespace Gurigi
                 DWRITE_FONT_STRETCH = DWRITE_FONT_STRETCH_NORMAL
                 );
 
-            friend class Batang::Singleton<FontFactory>;
+            friend class Batang::Singleton<FontFactory, Batang::DestructPriority::Normal, Batang::ExitBehavior::Skip>;
         };
     }
 }
@@ -6,7 +6,7 @@
 
 namespace Gurigi
 {
-    class ShortcutKey final : public Batang::Singleton<ShortcutKey>
+    class ShortcutKey final : public Batang::Singleton<ShortcutKey, Batang::DestructPriority::Normal, Batang::ExitBehavior::Skip>
     {
     public:
         enum class Modifier : uint8_t
@@ -75,6 +75,6 @@ namespace Gurigi
         uint32_t processShortcut(const Shell *, Key, bool, bool) const;
         bool processKey(const Shell *, bool, bool, bool, uint32_t, bool, uint32_t) const;
 
-        friend class Batang::Singleton<ShortcutKey>;
+        friend class Batang::Singleton<ShortcutKey, Batang::DestructPriority::Normal, Batang::ExitBehavior::Skip>;
     };
 }
@@ -4,6 +4,5 @@
 
 namespace Gurigi
 {
-    std::weak_ptr<Batang::ThreadTaskPool> UiThread::uiThread_;
-    std::mutex UiThread::mutex_;
+    Batang::EpochValue<std::weak_ptr<Batang::ThreadTaskPool>> UiThread::uiThread_;
 }
@@ -1,49 +1,47 @@
 ﻿#pragma once
 
+#include "../Batang/EpochValue.h"
 #include "../Batang/Thread.h"
 
 namespace Gurigi
 {
-    // TODO: minimize lock
+    // Posting to the UI thread is lock-free; only switching the UI thread takes a lock.
     class UiThread
     {
     public:
         static bool post(const std::function<void ()> &task)
         {
-            std::lock_guard<std::mutex> lock(mutex_);
-            auto luiThread = uiThread_.lock();
+            auto luiThread = lockUiThread();
             if(!luiThread)
                 return false;
             luiThread->post(task);
             return true;
         }
         template<typename Func>
-        static auto invoke(Func &&fn) -> boost::optional<std::future<decltype(fn())>>
+        static auto invoke(Func &&fn) -> boost::optional<Batang::InvokeFuture<decltype(fn())>>
         {
-            std::lock_guard<std::mutex> lock(mutex_);
-            auto luiThread = uiThread_.lock();
+            auto luiThread = lockUiThread();
             if(!luiThread)
                 return {};
             return luiThread->invoke(fn);
         }
 
     private:
+        static std::shared_ptr<Batang::ThreadTaskPool> lockUiThread()
+        {
+            return uiThread_.read([](const std::weak_ptr<Batang::ThreadTaskPool> &uiThread) { return uiThread.lock(); });
+        }
         static void set(std::weak_ptr<Batang::ThreadTaskPool> uiThread)
         {
-            std::lock_guard<std::mutex> lock(mutex_);
-            uiThread_ = std::move(uiThread);
+            uiThread_.store(std::move(uiThread));
         }
         static std::weak_ptr<Batang::ThreadTaskPool> exchange(std::weak_ptr<Batang::ThreadTaskPool> uiThread)
         {
-            std::lock_guard<std::mutex> lock(mutex_);
-            auto oldUiThread = uiThread_;
-            uiThread_ = std::move(uiThread);
-            return oldUiThread;
+            return uiThread_.exchange(std::move(uiThread));
         }
 
     private:
-        static std::weak_ptr<Batang::ThreadTaskPool> uiThread_;
-        static std::mutex mutex_;
+        static Batang::EpochValue<std::weak_ptr<Batang::ThreadTaskPool>> uiThread_;
 
         friend class FrameWindow;
     };
@@ -223,7 +223,7 @@ namespace Gurigi
     template<typename T = Shell>
     using ShellWeakPtr = WeakPtr<Shell, ShellPtrDeleter, T>;
 
-    class ControlManager final : public Batang::Singleton<ControlManager>
+    class ControlManager final : public Batang::Singleton<ControlManager, Batang::DestructPriority::Normal, Batang::ExitBehavior::Skip>
     {
     private:
         std::unordered_map<ControlId, ControlWeakPtr<>> controls_;
@@ -240,10 +240,10 @@ namespace Gurigi
         ControlWeakPtr<> find(ControlId);
         void remove(ControlId);
 
-        friend class Batang::Singleton<ControlManager>;
+        friend class Batang::Singleton<ControlManager, Batang::DestructPriority::Normal, Batang::ExitBehavior::Skip>;
     };
 
-    class ShellManager final : public Batang::Singleton<ShellManager>
+    class ShellManager final : public Batang::Singleton<ShellManager, Batang::DestructPriority::Normal, Batang::ExitBehavior::Skip>
     {
     private:
         std::map<HWND, ShellWeakPtr<>> shells_;
@@ -264,10 +264,10 @@ namespace Gurigi
         ShellWeakPtr<> find(HWND);
         void remove(HWND);
 
-        friend class Batang::Singleton<ShellManager>;
+        friend class Batang::Singleton<ShellManager, Batang::DestructPriority::Normal, Batang::ExitBehavior::Skip>;
     };
 
-    class Win32DpiUtil final : public Batang::Singleton<Win32DpiUtil>
+    class Win32DpiUtil final : public Batang::Singleton<Win32DpiUtil, Batang::DestructPriority::Normal, Batang::ExitBehavior::Skip>
     {
     private:
         typedef UINT(__stdcall *GetDpiForWindowPtr)(HWND);
@@ -287,6 +287,6 @@ namespace Gurigi
     public:
         uint32_t getDpiForWindow(HWND);
 
-        friend class Batang::Singleton<Win32DpiUtil>;
+        friend class Batang::Singleton<Win32DpiUtil, Batang::DestructPriority::Normal, Batang::ExitBehavior::Skip>;
     };
 }
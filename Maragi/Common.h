@@ -11,6 +11,8 @@
 #include <cstring>
 
 #include <exception>
+#include <limits>
+#include <list>
 #include <new>
 #include <numeric>
 #include <random>
@@ -29,8 +31,9 @@
 #include <curl/curl.h>
 #include <openssl/sha.h>
 // #include <twitcurl/twitcurl.h>
-#define RAPIDJSON_SSE2
-#include <rapidjson/rapidjson.h>
+#ifdef MARAGI_USE_ZLIB
+#include <zlib.h>
+#endif
 
 // Windows API inclusion; <windows.h> should be first.
 
@@ -40,34 +40,30 @@ namespace Maragi
         if(read % sizeof(wchar_t) != 0)
             return;
         buffer.resize(read / sizeof(wchar_t));
-        buffer.push_back(L'\0');
-        auto it = buffer.begin();
-        if(*it == L'\xFEFF')
-            ++ it;
 
-        std::wstring str(&*it), name, value;
-        std::wistringstream is(str);
-        size_t pos;
+        boost::wstring_view text(buffer.data(), buffer.size());
+        if(!text.empty() && text.front() == L'\xFEFF')
+            text.remove_prefix(1);
 
-        while(!is.eof())
+        for(auto &line: Batang::splitView(text, L"\n"))
         {
-            getline(is, str);
-
-            pos = str.find(L'=');
-            if(pos == std::wstring::npos)
+            size_t pos = line.find(L'=');
+            if(pos == boost::wstring_view::npos)
                 continue;
 
-            name.assign(str.begin(), str.begin() + pos);
-            value.assign(str.begin() + pos + 1, str.end());
-
-            name = Batang::trim(std::move(name));
-            value = Batang::trim(std::move(value));
+            auto name = Batang::trimView(line.substr(0, pos));
+            auto value = Batang::trimView(line.substr(pos + 1));
 
-            set(name, value, false);
+            set(std::wstring(name.begin(), name.end()), std::wstring(value.begin(), value.end()), false);
         }
     }
 
     Configure::~Configure()
+    {
+        flush();
+    }
+
+    void Configure::flush()
     {
         if(!changed_)
             return;
@@ -87,7 +83,8 @@ namespace Maragi
             return;
 
         ulong32_t written = 0;
-        WriteFile(file.get(), str.c_str(), static_cast<ulong32_t>(str.size() * sizeof(wchar_t)), &written, nullptr);
+        if(WriteFile(file.get(), str.c_str(), static_cast<ulong32_t>(str.size() * sizeof(wchar_t)), &written, nullptr))
+            changed_ = false;
     }
 
     std::wstring Configure::getConfigurePath()
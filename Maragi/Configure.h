@@ -4,7 +4,7 @@
 
 namespace Maragi
 {
-    class Configure final : public Batang::Singleton<Configure>
+    class Configure final : public Batang::Singleton<Configure, Batang::DestructPriority::Normal, Batang::ExitBehavior::Flush>
     {
     private:
         static const std::wstring ConfFileName;
@@ -32,7 +32,8 @@ namespace Maragi
         void setBinary(const std::wstring &, const std::vector<uint8_t> &);
         void setBinary(const std::wstring &, const void *, size_t);
         void remove(const std::wstring &);
+        void flush(); // writes the file if anything has changed
 
-        friend class Batang::Singleton<Configure>;
+        friend class Batang::Singleton<Configure, Batang::DestructPriority::Normal, Batang::ExitBehavior::Flush>;
     };
 }
@@ -19,5 +19,7 @@ namespace Maragi
         const char * const REQUEST_TOKEN = "oauth/request_token";
         const char * const AUTHORIZE = "oauth/authorize";
         const char * const ACCESS_TOKEN = "oauth/access_token";
+        const char * const USER_STREAM = "https://userstream.twitter.com/1.1/user.json";
+        const char * const HOME_TIMELINE = "1.1/statuses/home_timeline.json";
     }
 }
@@ -14,5 +14,7 @@ namespace Maragi
     {
         extern const char * const PROTOCOL, * const HOST;
         extern const char * const REQUEST_TOKEN, * const AUTHORIZE, * const ACCESS_TOKEN;
+        extern const char * const USER_STREAM;
+        extern const char * const HOME_TIMELINE;
     }
 }
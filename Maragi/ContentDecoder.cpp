@@ -0,0 +1,177 @@
+﻿#include "Common.h"
+
+#include "../Batang/Utility.h"
+
+#include "ContentDecoder.h"
+
+namespace Maragi
+{
+    const size_t ContentDecoder::BufferSize = 16 * 1024;
+#ifdef MARAGI_USE_ZLIB
+    const char * const ContentDecoder::AcceptEncoding = "gzip, deflate";
+#else
+    const char * const ContentDecoder::AcceptEncoding = "identity";
+#endif
+
+    struct ContentDecoder::Inflater
+    {
+#ifdef MARAGI_USE_ZLIB
+        static const int WindowBits = 15 + 32; // 32: detect a gzip or zlib header
+        static const size_t HeadSize = 2; // what a zlib header is told by
+
+        z_stream stream_;
+        bool raw_; // Content-Encoding: deflate sent without the zlib wrapper
+        std::string head_; // the first HeadSize bytes of the body, to start over as raw
+
+        Inflater()
+            : stream_()
+            , raw_(false)
+        {
+            if(inflateInit2(&stream_, WindowBits) != Z_OK)
+                throw(std::runtime_error("zlib initialization failed."));
+        }
+
+        ~Inflater()
+        {
+            inflateEnd(&stream_);
+        }
+
+        void reset()
+        {
+            inflateReset2(&stream_, WindowBits);
+            raw_ = false;
+            head_.clear();
+        }
+
+        // Z_OK once all of the data is taken, or the error which stopped it.
+        int feed(const char *data, size_t size, char *buffer, Stats &stats, const std::function<void (const char *, size_t)> &fn)
+        {
+            stream_.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+            stream_.avail_in = static_cast<uInt>(size);
+            do
+            {
+                stream_.next_out = reinterpret_cast<Bytef *>(buffer);
+                stream_.avail_out = static_cast<uInt>(BufferSize);
+
+                auto begin = std::chrono::steady_clock::now();
+                int result = inflate(&stream_, Z_NO_FLUSH);
+                stats.time_ += std::chrono::steady_clock::now() - begin;
+
+                size_t produced = BufferSize - stream_.avail_out;
+                if(produced > 0)
+                {
+                    stats.bytes_ += produced;
+                    fn(buffer, produced);
+                }
+
+                if(result == Z_STREAM_END)
+                {
+                    if(stream_.avail_in == 0)
+                        return Z_OK;
+                    inflateReset(&stream_); // the next gzip member; anything else fails as corrupt
+                }
+                else if(result == Z_BUF_ERROR) // a full buffer last time held all there was
+                    return Z_OK;
+                else if(result != Z_OK)
+                    return result;
+            } while(stream_.avail_in > 0 || stream_.avail_out == 0); // a full buffer may leave output behind
+            return Z_OK;
+        }
+#endif
+    };
+
+    ContentDecoder::ContentDecoder()
+        : encoding_(Identity)
+        , failed_(false)
+        , buffer_(new char[BufferSize])
+        , stats_()
+    {
+    }
+
+    ContentDecoder::~ContentDecoder()
+    {
+    }
+
+    bool ContentDecoder::parseHeader(boost::string_view line, Encoding &out)
+    {
+        size_t colon = line.find(':');
+        if(colon == boost::string_view::npos || !boost::iequals(Batang::trimView(line.substr(0, colon)), "content-encoding"))
+            return false;
+
+        boost::string_view value = Batang::trimView(line.substr(colon + 1));
+        if(value.empty() || boost::iequals(value, "identity"))
+            out = Identity;
+#ifdef MARAGI_USE_ZLIB
+        else if(boost::iequals(value, "gzip") || boost::iequals(value, "x-gzip") || boost::iequals(value, "deflate"))
+            out = Deflate;
+#endif
+        else
+            out = Unsupported;
+        return true;
+    }
+
+    void ContentDecoder::start(Encoding encoding)
+    {
+        encoding_ = encoding;
+        failed_ = false;
+
+#ifdef MARAGI_USE_ZLIB
+        if(encoding_ == Deflate)
+        {
+            if(!inflater_)
+                inflater_ = std::make_unique<Inflater>();
+            else
+                inflater_->reset();
+        }
+#endif
+    }
+
+    bool ContentDecoder::decode(const char *data, size_t size, const std::function<void (const char *, size_t)> &fn)
+    {
+        if(failed_)
+            return false;
+
+        stats_.wireBytes_ += size;
+        if(encoding_ == Identity)
+        {
+            stats_.bytes_ += size;
+            fn(data, size);
+            return true;
+        }
+
+#ifdef MARAGI_USE_ZLIB
+        if(encoding_ == Deflate)
+        {
+            Inflater &inflater = *inflater_;
+            size_t prior = inflater.head_.size(); // all of the body before this, if short of HeadSize
+            inflater.head_.append(data, std::min(size, Inflater::HeadSize - prior));
+
+            int result = inflater.feed(data, size, buffer_.get(), stats_, fn);
+            if(result == Z_DATA_ERROR && !inflater.raw_ && inflater.stream_.total_out == 0 && prior < Inflater::HeadSize)
+            {
+                // many servers send deflate as a bare deflate stream; start the body over as one
+                inflateReset2(&inflater.stream_, -15);
+                inflater.raw_ = true;
+                result = prior > 0 ? inflater.feed(inflater.head_.data(), prior, buffer_.get(), stats_, fn) : Z_OK;
+                if(result == Z_OK)
+                    result = inflater.feed(data, size, buffer_.get(), stats_, fn);
+            }
+
+            if(result != Z_OK)
+            {
+                failed_ = true;
+                return false;
+            }
+            return true;
+        }
+#endif
+
+        failed_ = true;
+        return false;
+    }
+
+    const ContentDecoder::Stats &ContentDecoder::stats() const
+    {
+        return stats_;
+    }
+}
@@ -0,0 +1,59 @@
+﻿#pragma once
+
+namespace Maragi
+{
+    // Decodes a response body sent with Content-Encoding: gzip or deflate as it arrives. The body may be
+    // cut anywhere; what is inflated is handed out through a fixed buffer, so the body is never collected.
+    // Gzip members following one another are all decoded; other bytes after the end are corrupt.
+    // Identity bodies pass through as they are. Without MARAGI_USE_ZLIB only identity is decoded, and
+    // AcceptEncoding asks for nothing else.
+    class ContentDecoder final
+    {
+    public:
+        enum Encoding
+        {
+            Identity,
+            Deflate, // gzip, zlib wrapped or bare; told from the header
+            Unsupported,
+        };
+
+        struct Stats
+        {
+            uint64_t wireBytes_; // as received
+            uint64_t bytes_; // decoded
+            std::chrono::nanoseconds time_; // spent inflating
+        };
+
+    private:
+        struct Inflater;
+
+    public:
+        static const size_t BufferSize;
+        static const char * const AcceptEncoding; // for CURLOPT_ACCEPT_ENCODING, with curl's own decoding off
+
+    private:
+        Encoding encoding_;
+        bool failed_;
+        std::unique_ptr<Inflater> inflater_; // made for the first compressed body, then reset for each
+        std::unique_ptr<char[]> buffer_;
+        Stats stats_;
+
+    public:
+        ContentDecoder();
+        ~ContentDecoder();
+
+    private:
+        ContentDecoder(const ContentDecoder &) = delete;
+        ContentDecoder &operator =(const ContentDecoder &) = delete;
+
+    public:
+        static bool parseHeader(boost::string_view line, Encoding &out); // false if the line is not Content-Encoding
+
+    public:
+        void start(Encoding); // begins a body; a decoder starts out expecting an identity body
+        // Calls fn with what the data decodes to; false, passing nothing more, once the body turns out
+        // corrupt or its encoding unsupported.
+        bool decode(const char *, size_t, const std::function<void (const char *, size_t)> &fn);
+        const Stats &stats() const;
+    };
+}
@@ -0,0 +1,80 @@
+﻿#include "Common.h"
+
+#include "CurlShare.h"
+
+#include "TwitterClient.h"
+
+namespace Maragi
+{
+    double CurlShare::Stats::reuseRate() const
+    {
+        if(transfers_ == 0)
+            return 0.0;
+        return static_cast<double>(reused_) / transfers_;
+    }
+
+    CurlShare::CurlShare()
+        : stats_()
+    {
+        TwitterClient::initializeCurl();
+
+        share_ = curl_share_init();
+        if(share_ == nullptr)
+            throw(std::runtime_error("CURL initialization failed."));
+
+        curl_share_setopt(share_, CURLSHOPT_LOCKFUNC, &lockCallback);
+        curl_share_setopt(share_, CURLSHOPT_UNLOCKFUNC, &unlockCallback);
+        curl_share_setopt(share_, CURLSHOPT_USERDATA, static_cast<void *>(this));
+
+        curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+        curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    }
+
+    CurlShare::~CurlShare()
+    {
+        curl_share_cleanup(share_);
+    }
+
+    void CurlShare::attach(CURL *curl)
+    {
+        curl_easy_setopt(curl, CURLOPT_SHARE, share_);
+    }
+
+    void CurlShare::record(CURL *curl)
+    {
+        long connects = 0;
+        curl_off_t connectTime = 0, appConnectTime = 0;
+        curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects);
+        curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connectTime);
+        curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &appConnectTime); // 0 for plain HTTP
+
+        std::lock_guard<std::mutex> lock(statsMutex_);
+        ++ stats_.transfers_;
+        if(connects == 0)
+            ++ stats_.reused_;
+        else
+            stats_.handshake_ += std::chrono::microseconds(std::max(connectTime, appConnectTime));
+
+        uint64_t fresh = stats_.transfers_ - stats_.reused_;
+        if(fresh > 0)
+            stats_.handshakeSaved_ = stats_.handshake_ / fresh * stats_.reused_;
+    }
+
+    CurlShare::Stats CurlShare::stats() const
+    {
+        std::lock_guard<std::mutex> lock(statsMutex_);
+        return stats_;
+    }
+
+    void CurlShare::lockCallback(CURL *, curl_lock_data data, curl_lock_access, void *param)
+    {
+        // shared access is rare enough here that a plain mutex per data kind does
+        static_cast<CurlShare *>(param)->locks_[data].lock();
+    }
+
+    void CurlShare::unlockCallback(CURL *, curl_lock_data data, void *param)
+    {
+        static_cast<CurlShare *>(param)->locks_[data].unlock();
+    }
+}
@@ -0,0 +1,44 @@
+﻿#pragma once
+
+#include "../Batang/Singleton.h"
+
+namespace Maragi
+{
+    // Process-wide curl share handle. Easy handles attached to it reuse DNS lookups, TLS sessions
+    // and connections to the same host across accounts and across request kinds.
+    class CurlShare final : public Batang::Singleton<CurlShare, Batang::DestructPriority::Normal, Batang::ExitBehavior::Skip>
+    {
+    public:
+        struct Stats
+        {
+            uint64_t transfers_;
+            uint64_t reused_; // transfers which opened no new connection
+            std::chrono::microseconds handshake_; // connect and TLS time spent on new connections
+            std::chrono::microseconds handshakeSaved_; // reused transfers, priced at the average handshake
+
+            double reuseRate() const;
+        };
+
+    private:
+        CURLSH *share_;
+        std::mutex locks_[CURL_LOCK_DATA_LAST];
+
+        mutable std::mutex statsMutex_;
+        Stats stats_;
+
+    private:
+        CurlShare();
+        ~CurlShare();
+
+    public:
+        void attach(CURL *); // before the transfer starts; the handle must be cleaned up before this dies
+        void record(CURL *); // after a transfer ends
+        Stats stats() const;
+
+    private:
+        static void lockCallback(CURL *, curl_lock_data, curl_lock_access, void *);
+        static void unlockCallback(CURL *, curl_lock_data, void *);
+
+        friend class Batang::Singleton<CurlShare, Batang::DestructPriority::Normal, Batang::ExitBehavior::Skip>;
+    };
+}
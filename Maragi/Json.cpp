@@ -0,0 +1,536 @@
+﻿#include "Common.h"
+
+#include "Json.h"
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define MARAGI_JSON_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace Maragi
+{
+    namespace
+    {
+        struct BlockMasks // one bit per byte of a 64-byte block
+        {
+            uint64_t quote_;
+            uint64_t backslash_;
+            uint64_t structural_; // { } [ ] : ,
+        };
+
+        inline void classify(const char *block, BlockMasks &masks)
+        {
+            masks = BlockMasks();
+#ifdef MARAGI_JSON_SSE2
+            for(int i = 0; i < 4; ++ i)
+            {
+                __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block + i * 16));
+                __m128i folded = _mm_or_si128(bytes, _mm_set1_epi8(0x20)); // '[' and ']' become '{' and '}'
+                __m128i structural = _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(folded, _mm_set1_epi8('{')), _mm_cmpeq_epi8(folded, _mm_set1_epi8('}'))),
+                    _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(':')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8(','))));
+
+                masks.quote_ |= static_cast<uint64_t>(static_cast<uint16_t>(
+                    _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('"'))))) << (i * 16);
+                masks.backslash_ |= static_cast<uint64_t>(static_cast<uint16_t>(
+                    _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\\'))))) << (i * 16);
+                masks.structural_ |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(structural))) << (i * 16);
+            }
+#else
+            for(int i = 0; i < 64; ++ i)
+            {
+                uint64_t bit = static_cast<uint64_t>(1) << i;
+                switch(block[i])
+                {
+                case '"':
+                    masks.quote_ |= bit;
+                    break;
+                case '\\':
+                    masks.backslash_ |= bit;
+                    break;
+                case '{': case '}': case '[': case ']': case ':': case ',':
+                    masks.structural_ |= bit;
+                    break;
+                }
+            }
+#endif
+        }
+
+        // Characters escaped by an odd-length run of backslashes; carries a run across blocks in prevOddRun.
+        inline uint64_t escapedChars(uint64_t backslash, uint64_t &prevOddRun)
+        {
+            const uint64_t evenBits = 0x5555555555555555ull, oddBits = ~evenBits;
+
+            uint64_t startEdges = backslash & ~(backslash << 1);
+            uint64_t evenStartMask = evenBits ^ prevOddRun;
+            uint64_t evenStarts = startEdges & evenStartMask;
+            uint64_t oddStarts = startEdges & ~evenStartMask;
+
+            uint64_t evenCarries = backslash + evenStarts;
+            uint64_t oddCarries = backslash + oddStarts;
+            bool endsOddRun = oddCarries < backslash; // the run reached the end of the block
+            oddCarries |= prevOddRun;
+            prevOddRun = endsOddRun ? 1 : 0;
+
+            uint64_t evenCarryEnds = evenCarries & ~backslash;
+            uint64_t oddCarryEnds = oddCarries & ~backslash;
+            return (evenCarryEnds & oddBits) | (oddCarryEnds & evenBits);
+        }
+
+        // Bit i becomes the parity of bits 0..i; turns quote positions into an inside-string mask.
+        inline uint64_t prefixXor(uint64_t bits)
+        {
+            bits ^= bits << 1;
+            bits ^= bits << 2;
+            bits ^= bits << 4;
+            bits ^= bits << 8;
+            bits ^= bits << 16;
+            bits ^= bits << 32;
+            return bits;
+        }
+
+        inline uint32_t countTrailingZeros(uint64_t value)
+        {
+#ifdef _MSC_VER
+            unsigned long index;
+#ifdef _M_X64
+            _BitScanForward64(&index, value);
+#else
+            if(!_BitScanForward(&index, static_cast<uint32_t>(value)))
+            {
+                _BitScanForward(&index, static_cast<uint32_t>(value >> 32));
+                index += 32;
+            }
+#endif
+            return index;
+#else
+            return __builtin_ctzll(value);
+#endif
+        }
+
+        inline bool isSpace(char ch)
+        {
+            return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n';
+        }
+
+        inline int hexValue(char ch)
+        {
+            if(ch >= '0' && ch <= '9')
+                return ch - '0';
+            else if(ch >= 'a' && ch <= 'f')
+                return ch - 'a' + 10;
+            else if(ch >= 'A' && ch <= 'F')
+                return ch - 'A' + 10;
+            return -1;
+        }
+
+        bool readHex4(const char *p, const char *end, uint32_t &out)
+        {
+            if(end - p < 4)
+                return false;
+
+            out = 0;
+            for(int i = 0; i < 4; ++ i)
+            {
+                int value = hexValue(p[i]);
+                if(value < 0)
+                    return false;
+                out = (out << 4) | static_cast<uint32_t>(value);
+            }
+            return true;
+        }
+
+        void appendUtf8(uint32_t cp, std::string &out)
+        {
+            if(cp < 0x80)
+                out += static_cast<char>(cp);
+            else if(cp < 0x800)
+            {
+                out += static_cast<char>(0xC0 | (cp >> 6));
+                out += static_cast<char>(0x80 | (cp & 0x3F));
+            }
+            else if(cp < 0x10000)
+            {
+                out += static_cast<char>(0xE0 | (cp >> 12));
+                out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (cp & 0x3F));
+            }
+            else
+            {
+                out += static_cast<char>(0xF0 | (cp >> 18));
+                out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+                out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (cp & 0x3F));
+            }
+        }
+
+        // Unescapes the inside of a string; lone surrogates are dropped like the UTF transcoders do.
+        bool unescape(const char *p, const char *end, std::string &out)
+        {
+            while(p < end)
+            {
+                auto backslash = static_cast<const char *>(std::memchr(p, '\\', end - p));
+                if(!backslash)
+                {
+                    out.append(p, end);
+                    break;
+                }
+
+                out.append(p, backslash);
+                p = backslash + 1;
+                if(p == end)
+                    return false;
+
+                switch(*p ++)
+                {
+                case '"': out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/': out += '/'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u':
+                    {
+                        uint32_t cp;
+                        if(!readHex4(p, end, cp))
+                            return false;
+                        p += 4;
+
+                        if(cp >= 0xD800 && cp <= 0xDBFF)
+                        {
+                            uint32_t low;
+                            if(end - p >= 6 && p[0] == '\\' && p[1] == 'u' && readHex4(p + 2, end, low) && low >= 0xDC00 && low <= 0xDFFF)
+                            {
+                                p += 6;
+                                appendUtf8(0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00), out);
+                            }
+                        }
+                        else if(cp < 0xDC00 || cp > 0xDFFF)
+                            appendUtf8(cp, out);
+                    }
+                    break;
+                default:
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+
+    JsonValue::JsonValue()
+        : doc_(nullptr)
+        , offset_(0)
+        , index_(0)
+    {
+    }
+
+    JsonValue::JsonValue(const JsonDocument *doc, size_t offset, size_t index)
+        : doc_(doc)
+        , offset_(offset)
+        , index_(index)
+    {
+    }
+
+    JsonValue::Type JsonValue::type() const
+    {
+        if(!doc_ || offset_ >= doc_->json_.size())
+            return Invalid;
+
+        char ch = doc_->json_[offset_];
+        switch(ch)
+        {
+        case '{':
+            return Object;
+        case '[':
+            return Array;
+        case '"':
+            return String;
+        case 't': case 'f':
+            return Bool;
+        case 'n':
+            return Null;
+        default:
+            if(ch == '-' || (ch >= '0' && ch <= '9'))
+                return Number;
+            return Invalid;
+        }
+    }
+
+    bool JsonValue::find(boost::string_view key, JsonValue &out) const
+    {
+        if(type() != Object)
+            return false;
+
+        const auto &structurals = doc_->structurals_;
+        std::string unescaped;
+
+        for(size_t i = index_ + 1; ; )
+        {
+            if(doc_->at(i) != '"' || doc_->at(i + 1) != ':') // empty object, or not a key
+                return false;
+
+            JsonValue name(doc_, structurals[i], i);
+            JsonValue value(doc_, doc_->skipSpaces(structurals[i + 1] + 1), i + 2);
+
+            boost::string_view raw = name.rawString();
+            if(raw.find('\\') != boost::string_view::npos)
+            {
+                unescaped.clear();
+                if(name.getString(unescaped))
+                    raw = unescaped;
+            }
+            if(raw == key)
+            {
+                out = value;
+                return true;
+            }
+
+            size_t next = value.skip();
+            if(doc_->at(next) != ',')
+                return false;
+            i = next + 1;
+        }
+    }
+
+    bool JsonValue::forEach(const std::function<void (const JsonValue &)> &fn) const
+    {
+        if(type() != Array)
+            return false;
+
+        size_t offset = doc_->skipSpaces(offset_ + 1);
+        if(offset < doc_->json_.size() && doc_->json_[offset] == ']')
+            return true;
+
+        for(size_t i = index_ + 1; ; )
+        {
+            JsonValue element(doc_, offset, i);
+            if(element.type() == Invalid)
+                return false;
+            fn(element);
+
+            size_t next = element.skip();
+            char delimiter = doc_->at(next);
+            if(delimiter == ']')
+                return true;
+            else if(delimiter != ',')
+                return false;
+
+            i = next + 1;
+            offset = doc_->skipSpaces(doc_->structurals_[next] + 1);
+        }
+    }
+
+    bool JsonValue::getBool(bool &out) const
+    {
+        boost::string_view text = raw();
+        if(text == "true")
+            out = true;
+        else if(text == "false")
+            out = false;
+        else
+            return false;
+        return true;
+    }
+
+    bool JsonValue::getInt64(int64_t &out) const
+    {
+        boost::string_view text = raw();
+        bool negative = !text.empty() && text[0] == '-';
+        if(negative)
+            text.remove_prefix(1);
+
+        if(text.empty() || text.size() > 19)
+            return false;
+
+        uint64_t value = 0;
+        for(char ch: text)
+        {
+            if(ch < '0' || ch > '9')
+                return false;
+            value = value * 10 + static_cast<uint64_t>(ch - '0');
+        }
+
+        if(value > static_cast<uint64_t>(std::numeric_limits<int64_t>::max()) + (negative ? 1 : 0))
+            return false;
+        out = negative ? static_cast<int64_t>(0 - value) : static_cast<int64_t>(value);
+        return true;
+    }
+
+    bool JsonValue::getUint64(uint64_t &out) const
+    {
+        boost::string_view text = raw();
+        if(text.empty() || text.size() > 20)
+            return false;
+
+        uint64_t value = 0;
+        for(char ch: text)
+        {
+            if(ch < '0' || ch > '9')
+                return false;
+
+            uint64_t digit = static_cast<uint64_t>(ch - '0');
+            if(value > (std::numeric_limits<uint64_t>::max() - digit) / 10)
+                return false;
+            value = value * 10 + digit;
+        }
+
+        out = value;
+        return true;
+    }
+
+    bool JsonValue::getString(std::string &out) const
+    {
+        size_t end = stringEnd();
+        if(end == boost::string_view::npos)
+            return false;
+
+        const char *json = doc_->json_.data();
+        return unescape(json + offset_ + 1, json + end, out);
+    }
+
+    boost::string_view JsonValue::rawString() const
+    {
+        size_t end = stringEnd();
+        if(end == boost::string_view::npos)
+            return boost::string_view();
+        return doc_->json_.substr(offset_ + 1, end - offset_ - 1);
+    }
+
+    boost::string_view JsonValue::raw() const
+    {
+        size_t end;
+        switch(type())
+        {
+        case Invalid:
+            return boost::string_view();
+        case String:
+            end = stringEnd();
+            if(end == boost::string_view::npos)
+                return boost::string_view();
+            ++ end;
+            break;
+        case Object:
+        case Array:
+            end = doc_->structurals_[skip() - 1] + 1;
+            break;
+        default:
+            end = doc_->structurals_[index_];
+            while(end > offset_ && isSpace(doc_->json_[end - 1]))
+                -- end;
+            break;
+        }
+        return doc_->json_.substr(offset_, end - offset_);
+    }
+
+    size_t JsonValue::skip() const
+    {
+        switch(type())
+        {
+        case Object:
+        case Array:
+            {
+                // brackets are counted, not matched; on-demand parsing leaves that to whoever reads inside
+                size_t i = index_;
+                int depth = 0;
+                do
+                {
+                    char ch = doc_->at(i);
+                    if(ch == '{' || ch == '[')
+                        ++ depth;
+                    else if(ch == '}' || ch == ']')
+                        -- depth;
+                    else if(ch == '\0') // ran into the sentinel
+                        return i;
+                    ++ i;
+                } while(depth > 0);
+                return i;
+            }
+        case String:
+            return index_ + 1;
+        default:
+            return index_;
+        }
+    }
+
+    size_t JsonValue::stringEnd() const
+    {
+        if(type() != String)
+            return boost::string_view::npos;
+
+        // closing quotes are not indexed; the one before the next structural is it
+        size_t end = doc_->structurals_[index_ + 1];
+        while(end > offset_ + 1 && isSpace(doc_->json_[end - 1]))
+            -- end;
+        if(end <= offset_ + 1 || doc_->json_[end - 1] != '"')
+            return boost::string_view::npos;
+        return end - 1;
+    }
+
+    JsonDocument::JsonDocument()
+    {
+    }
+
+    bool JsonDocument::parse(boost::string_view json)
+    {
+        json_ = json;
+        structurals_.clear();
+        if(json.empty() || json.size() >= std::numeric_limits<uint32_t>::max())
+            return false;
+
+        uint64_t prevOddRun = 0, prevInString = 0;
+        for(size_t base = 0; base < json.size(); base += 64)
+        {
+            BlockMasks masks;
+            if(json.size() - base >= 64)
+                classify(json.data() + base, masks);
+            else
+            {
+                char tail[64];
+                std::memset(tail, ' ', sizeof(tail));
+                std::memcpy(tail, json.data() + base, json.size() - base);
+                classify(tail, masks);
+            }
+
+            uint64_t quotes = masks.quote_ & ~escapedChars(masks.backslash_, prevOddRun);
+            uint64_t inString = prefixXor(quotes) ^ prevInString; // from an opening quote up to its closing one
+            prevInString = 0 - (inString >> 63);
+
+            // structural characters outside strings, and opening quotes
+            uint64_t bits = (masks.structural_ & ~inString) | (quotes & inString);
+            while(bits != 0)
+            {
+                structurals_.push_back(static_cast<uint32_t>(base + countTrailingZeros(bits)));
+                bits &= bits - 1;
+            }
+        }
+
+        if(prevInString != 0)
+            return false;
+
+        structurals_.push_back(static_cast<uint32_t>(json.size()));
+        return skipSpaces(0) < json.size();
+    }
+
+    JsonValue JsonDocument::root() const
+    {
+        if(structurals_.empty())
+            return JsonValue();
+        return JsonValue(this, skipSpaces(0), 0);
+    }
+
+    char JsonDocument::at(size_t index) const
+    {
+        if(index >= structurals_.size() || structurals_[index] >= json_.size())
+            return '\0';
+        return json_[structurals_[index]];
+    }
+
+    size_t JsonDocument::skipSpaces(size_t offset) const
+    {
+        while(offset < json_.size() && isSpace(json_[offset]))
+            ++ offset;
+        return offset;
+    }
+}
@@ -0,0 +1,77 @@
+﻿#pragma once
+
+namespace Maragi
+{
+    class JsonDocument;
+
+    // On-demand view of one value in a JsonDocument. Nothing is decoded until asked for, and only
+    // what is read gets validated; a getter returns false for a value of another type or a malformed one.
+    class JsonValue
+    {
+    public:
+        enum Type
+        {
+            Invalid,
+            Null,
+            Bool,
+            Number,
+            String,
+            Array,
+            Object,
+        };
+
+    private:
+        const JsonDocument *doc_;
+        size_t offset_; // first byte of the value
+        size_t index_; // first structural at or after offset_
+
+    public:
+        JsonValue();
+
+    private:
+        JsonValue(const JsonDocument *, size_t offset, size_t index);
+
+    public:
+        Type type() const;
+
+        bool find(boost::string_view key, JsonValue &out) const; // member of an object; keys are compared unescaped
+        bool forEach(const std::function<void (const JsonValue &)> &fn) const; // elements of an array
+
+        bool getBool(bool &out) const;
+        bool getInt64(int64_t &out) const;
+        bool getUint64(uint64_t &out) const;
+        bool getString(std::string &out) const; // unescaped UTF-8, appended
+        boost::string_view rawString() const; // between the quotes, escapes left as they are
+        boost::string_view raw() const; // the whole value as in the text
+
+    private:
+        size_t skip() const; // index of the structural after this value
+        size_t stringEnd() const; // offset of the closing quote
+
+        friend class JsonDocument;
+    };
+
+    // Two-stage JSON parser after simdjson (Langdale and Lemire, "Parsing Gigabytes of JSON per Second").
+    // parse() builds an index of structural characters and string openings 64 bytes at a time with SSE2;
+    // JsonValue then walks the index instead of the text, so skipping a subtree costs one step per
+    // structural in it. The text must outlive the document; the index is reused across parse() calls.
+    class JsonDocument final
+    {
+    private:
+        boost::string_view json_;
+        std::vector<uint32_t> structurals_; // offsets; the last one is json_.size(), a sentinel
+
+    public:
+        JsonDocument();
+
+    public:
+        bool parse(boost::string_view); // false if a string is left open or the text is empty
+        JsonValue root() const;
+
+    private:
+        char at(size_t index) const; // character of a structural; '\0' at the sentinel
+        size_t skipSpaces(size_t offset) const;
+
+        friend class JsonValue;
+    };
+}
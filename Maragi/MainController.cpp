@@ -1,9 +1,15 @@
 ﻿#include "Common.h"
 
 #include "../Batang/Error.h"
+#include "../Batang/Global.h"
 #include "../Batang/Timer.h"
+#include "../Batang/WorkerPool.h"
 
+#include "../Gurigi/ComUtility.h"
 #include "../Gurigi/Controls.h"
+#include "../Gurigi/Drawing.h"
+#include "../Gurigi/ShortcutKey.h"
+#include "../Gurigi/Utility.h"
 #include "../Gurigi/Window.h"
 #include "../Gurigi/FrameWindow.h"
 
@@ -57,6 +63,8 @@ namespace Maragi
                 return true;
             }
 
+            initialize();
+
             // TwitterClient tc;
             // tc.authorize();
 
@@ -136,6 +144,8 @@ namespace Maragi
                 }
             };
 
+            OutputDebugStringA(Batang::SingletonManager::report().c_str());
+
             WINDOWPLACEMENT wp = {0, };
             if(Configure::instance().getBinary(L"Placement", &wp, sizeof(wp)) == sizeof(wp))
             {
@@ -177,6 +187,30 @@ namespace Maragi
     {
     }
 
+    void MainController::initialize()
+    {
+        auto &inits = Batang::GlobalInitializerManager::instance();
+        auto none = []() {};
+
+        // COM is apartment-bound; keep it on this (UI) thread and let the rest spread over workers.
+        inits.enqueue("ComInitializer", []() { Gurigi::ComInitializer::instance(); }, none, {}, Batang::InitAffinity::CallerThread);
+        inits.enqueue("D2DFactory", []() { Gurigi::Drawing::D2DFactory::instance(); }, none, { "ComInitializer" });
+        inits.enqueue("FontFactory", []() { Gurigi::Drawing::FontFactory::instance(); }, none, { "D2DFactory" });
+        inits.enqueue("Configure", []() { Configure::instance(); }, none);
+        inits.enqueue("Curl", []() { TwitterClient::initializeCurl(); }, none);
+
+        // the one UI singleton whose construction shows in the startup report (it loads user32 and shcore);
+        // the managers construct in no time and are left to their first use
+        auto prewarmed = Batang::WorkerPool::instance().prewarm<Gurigi::Win32DpiUtil>();
+
+        inits.initializeAll();
+
+        for(auto &future: prewarmed)
+            future.get(); // rethrows what the constructor threw
+
+        OutputDebugStringA(inits.report().c_str());
+    }
+
     int MainController::filterOSException(unsigned code, EXCEPTION_POINTERS *ep)
     {
         return showOSException(code, ep) ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH;
@@ -212,7 +246,13 @@ namespace Maragi
 
 int __stdcall wWinMain(HINSTANCE instance, HINSTANCE, wchar_t *commandLine, int showCommand)
 {
-    return Maragi::MainController::instance().runFromThisThread(commandLine, showCommand) ? 0 : 1;
+    int exitCode = Maragi::MainController::instance().runFromThisThread(commandLine, showCommand) ? 0 : 1;
+
+    // everything but the configuration is in memory only; no need to tear it down piece by piece
+    if(Maragi::Configure::instance().get(L"FastExit", L"1") != L"0")
+        Batang::SingletonManager::fastExit(exitCode);
+
+    return exitCode;
 }
 
 #pragma warning(pop)
@@ -5,7 +5,7 @@
 
 namespace Maragi
 {
-    class MainController final : public Batang::Thread<MainController>, public Batang::Singleton<MainController>
+    class MainController final : public Batang::Thread<MainController>, public Batang::Singleton<MainController, Batang::DestructPriority::Normal, Batang::ExitBehavior::Skip>
     {
     private:
         boost::program_options::variables_map cmdLine_;
@@ -21,12 +21,13 @@ namespace Maragi
 
     private:
         void registerEvents();
+        void initialize();
         int filterOSException(unsigned, EXCEPTION_POINTERS *);
         bool showOSException(unsigned, EXCEPTION_POINTERS *);
         bool checkPrerequisites();
         void parseCommandLine(const std::wstring &);
 
         friend class Batang::Thread<MainController>;
-        friend class Batang::Singleton<MainController>;
+        friend class Batang::Singleton<MainController, Batang::DestructPriority::Normal, Batang::ExitBehavior::Skip>;
     };
 }
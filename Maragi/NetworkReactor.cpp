@@ -0,0 +1,311 @@
+﻿#include "Common.h"
+
+#include "NetworkReactor.h"
+
+#include "CurlShare.h"
+#include "TwitterClient.h"
+
+namespace Maragi
+{
+    namespace Detail
+    {
+        class ReactorThread final : public Batang::Thread<ReactorThread>
+        {
+        private:
+            SOCKET wakeSocket_; // loopback UDP socket connected to itself; a datagram cuts WSAPoll short
+            boost::signals2::connection wakeup_;
+
+        public:
+            ReactorThread();
+            ~ReactorThread();
+
+        public:
+            virtual std::string name() const override;
+            void stop();
+
+        private:
+            void run(NetworkReactor *reactor);
+
+            friend class Batang::Thread<ReactorThread>;
+        };
+
+        ReactorThread::ReactorThread()
+        {
+            wakeSocket_ = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+            if(wakeSocket_ == INVALID_SOCKET)
+                throw(std::runtime_error("NetworkReactor: cannot create the wakeup socket."));
+
+            sockaddr_in addr = {};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            int addrSize = sizeof(addr);
+            u_long nonBlocking = 1;
+
+            if(bind(wakeSocket_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0
+                || getsockname(wakeSocket_, reinterpret_cast<sockaddr *>(&addr), &addrSize) != 0
+                || connect(wakeSocket_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0
+                || ioctlsocket(wakeSocket_, FIONBIO, &nonBlocking) != 0)
+            {
+                closesocket(wakeSocket_);
+                throw(std::runtime_error("NetworkReactor: cannot set up the wakeup socket."));
+            }
+
+            wakeup_ = onTaskInvoked.connect([this]()
+            {
+                char ch = 0;
+                send(wakeSocket_, &ch, 1, 0);
+            });
+        }
+
+        ReactorThread::~ReactorThread()
+        {
+            onTaskInvoked -= wakeup_;
+            closesocket(wakeSocket_);
+        }
+
+        std::string ReactorThread::name() const
+        {
+            return "NetworkReactor";
+        }
+
+        void ReactorThread::stop()
+        {
+            postQuitProcess();
+            join();
+        }
+
+        void ReactorThread::run(NetworkReactor *reactor)
+        {
+            while(process())
+                reactor->poll(wakeSocket_);
+        }
+    }
+
+    NetworkReactor::NetworkReactor()
+        : transferCount_(0)
+        , timeoutSet_(false)
+    {
+        TwitterClient::initializeCurl();
+
+        multi_ = curl_multi_init();
+        if(multi_ == nullptr)
+            throw(std::runtime_error("CURL initialization failed."));
+
+        curl_multi_setopt(multi_, CURLMOPT_SOCKETFUNCTION, &socketCallback);
+        curl_multi_setopt(multi_, CURLMOPT_SOCKETDATA, static_cast<void *>(this));
+        curl_multi_setopt(multi_, CURLMOPT_TIMERFUNCTION, &timerCallback);
+        curl_multi_setopt(multi_, CURLMOPT_TIMERDATA, static_cast<void *>(this));
+
+        thread_.reset(new Detail::ReactorThread());
+        thread_->start(this);
+    }
+
+    NetworkReactor::~NetworkReactor()
+    {
+        thread_->stop();
+        thread_ = nullptr; // delete preemptively
+
+        // the thread has ended; what it left is safe to touch from here
+        for(auto &transfer: transfers_)
+            curl_multi_remove_handle(multi_, transfer.first);
+        transfers_.clear();
+        curl_multi_cleanup(multi_);
+    }
+
+    void NetworkReactor::add(CURL *curl, std::weak_ptr<Batang::ThreadTaskPool> owner, CompletionHandler onDone)
+    {
+        thread_->post([this, curl, owner, onDone]()
+        {
+            addTransfer(curl, [owner, onDone](CURLcode result, long status)
+            {
+                auto ownerLocked = owner.lock();
+                if(ownerLocked)
+                    ownerLocked->post([onDone, result, status]() { onDone(result, status); });
+            });
+        });
+    }
+
+    void NetworkReactor::remove(CURL *curl)
+    {
+        if(Batang::ThreadTaskPool::current().lock() == thread_)
+            removeTransfer(curl);
+        else
+            thread_->invoke([this, curl]() { removeTransfer(curl); }).get();
+    }
+
+    CURLcode NetworkReactor::perform(CURL *curl)
+    {
+        auto done = std::make_shared<std::promise<CURLcode>>();
+        auto future = done->get_future();
+
+        thread_->post([this, curl, done]()
+        {
+            addTransfer(curl, [done](CURLcode result, long) { done->set_value(result); });
+        });
+
+        return future.get();
+    }
+
+    void NetworkReactor::resume(CURL *curl)
+    {
+        thread_->post([this, curl]()
+        {
+            if(transfers_.find(curl) == transfers_.end()) // ended, or removed while paused
+                return;
+
+            curl_easy_pause(curl, CURLPAUSE_CONT); // may deliver what it held back right away
+            checkDone();
+        });
+    }
+
+    size_t NetworkReactor::transferCount() const
+    {
+        return transferCount_;
+    }
+
+    int NetworkReactor::socketCallback(CURL *, curl_socket_t socket, int what, void *param, void *)
+    {
+        NetworkReactor *reactor = static_cast<NetworkReactor *>(param);
+
+        switch(what)
+        {
+        case CURL_POLL_IN:
+            reactor->sockets_[socket] = POLLRDNORM;
+            break;
+        case CURL_POLL_OUT:
+            reactor->sockets_[socket] = POLLWRNORM;
+            break;
+        case CURL_POLL_INOUT:
+            reactor->sockets_[socket] = POLLRDNORM | POLLWRNORM;
+            break;
+        case CURL_POLL_REMOVE:
+            reactor->sockets_.erase(socket);
+            break;
+        }
+
+        return 0;
+    }
+
+    int NetworkReactor::timerCallback(CURLM *, long timeoutMs, void *param)
+    {
+        NetworkReactor *reactor = static_cast<NetworkReactor *>(param);
+
+        reactor->timeoutSet_ = timeoutMs >= 0;
+        if(reactor->timeoutSet_)
+            reactor->timeoutAt_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+
+        return 0;
+    }
+
+    void NetworkReactor::addTransfer(CURL *curl, CompletionHandler onDone)
+    {
+        if(curl_multi_add_handle(multi_, curl) != CURLM_OK)
+        {
+            onDone(CURLE_FAILED_INIT, 0);
+            return;
+        }
+
+        transfers_.emplace(curl, std::move(onDone));
+        ++ transferCount_;
+    }
+
+    void NetworkReactor::removeTransfer(CURL *curl)
+    {
+        auto it = transfers_.find(curl);
+        if(it == transfers_.end()) // already done
+            return;
+
+        curl_multi_remove_handle(multi_, curl);
+        transfers_.erase(it);
+        -- transferCount_;
+    }
+
+    void NetworkReactor::poll(SOCKET wakeSocket)
+    {
+        std::vector<WSAPOLLFD> fds;
+        fds.reserve(sockets_.size() + 1);
+
+        WSAPOLLFD wake = { wakeSocket, POLLRDNORM, 0 };
+        fds.push_back(wake);
+        for(auto &socket: sockets_)
+        {
+            WSAPOLLFD fd = { socket.first, socket.second, 0 };
+            fds.push_back(fd);
+        }
+
+        INT timeout = -1; // only a posted task or a socket can wake us up
+        if(timeoutSet_)
+        {
+            auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(timeoutAt_ - std::chrono::steady_clock::now()).count();
+            timeout = static_cast<INT>(std::max<long long>(remaining, 0));
+        }
+
+        int running = 0;
+        if(WSAPoll(&fds[0], static_cast<ULONG>(fds.size()), timeout) > 0)
+        {
+            if(fds[0].revents != 0)
+            {
+                char buf[64];
+                while(recv(wakeSocket, buf, sizeof(buf), 0) > 0)
+                    ;
+            }
+
+            for(auto it = fds.begin() + 1; it != fds.end(); ++ it)
+            {
+                if(it->revents == 0)
+                    continue;
+
+                int action = 0;
+                if(it->revents & (POLLRDNORM | POLLHUP))
+                    action |= CURL_CSELECT_IN;
+                if(it->revents & POLLWRNORM)
+                    action |= CURL_CSELECT_OUT;
+                if(it->revents & (POLLERR | POLLNVAL))
+                    action |= CURL_CSELECT_ERR;
+
+                curl_multi_socket_action(multi_, it->fd, action, &running);
+            }
+        }
+
+        // WSAPoll may miss a failed connect on older Windows; curl's own timeouts catch that here
+        if(timeoutSet_ && std::chrono::steady_clock::now() >= timeoutAt_)
+        {
+            timeoutSet_ = false;
+            curl_multi_socket_action(multi_, CURL_SOCKET_TIMEOUT, 0, &running);
+        }
+
+        checkDone();
+    }
+
+    void NetworkReactor::checkDone()
+    {
+        CURLMsg *msg;
+        int left;
+        while((msg = curl_multi_info_read(multi_, &left)) != nullptr)
+        {
+            if(msg->msg != CURLMSG_DONE)
+                continue;
+
+            // msg is freed by curl_multi_remove_handle
+            CURL *curl = msg->easy_handle;
+            CURLcode result = msg->data.result;
+            long status = 0;
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+            CurlShare::instance().record(curl);
+
+            auto it = transfers_.find(curl);
+            if(it == transfers_.end())
+            {
+                curl_multi_remove_handle(multi_, curl);
+                continue;
+            }
+
+            CompletionHandler onDone = std::move(it->second);
+            transfers_.erase(it);
+            -- transferCount_;
+            curl_multi_remove_handle(multi_, curl);
+
+            onDone(result, status);
+        }
+    }
+}
@@ -0,0 +1,59 @@
+﻿#pragma once
+
+#include "../Batang/Singleton.h"
+#include "../Batang/Thread.h"
+
+namespace Maragi
+{
+    class NetworkReactor;
+
+    namespace Detail
+    {
+        class ReactorThread;
+    }
+
+    // Runs curl transfers of every client on one thread, driven by curl_multi_socket_action.
+    // Easy handles stay owned by their callers; the reactor only adds them to its multi handle.
+    // Callbacks set on a handle (CURLOPT_WRITEFUNCTION, ...) run on the reactor thread.
+    class NetworkReactor final : public Batang::Singleton<NetworkReactor, Batang::DestructPriority::Fast, Batang::ExitBehavior::Skip>
+    {
+    public:
+        typedef std::function<void (CURLcode, long)> CompletionHandler; // transfer result, HTTP status
+
+    private:
+        std::shared_ptr<Detail::ReactorThread> thread_;
+        std::atomic<size_t> transferCount_;
+
+        // below are touched on the reactor thread only
+        CURLM *multi_;
+        std::unordered_map<CURL *, CompletionHandler> transfers_; // handlers are called on the reactor thread
+        std::unordered_map<curl_socket_t, short> sockets_; // poll events curl asks for
+        std::chrono::steady_clock::time_point timeoutAt_;
+        bool timeoutSet_;
+
+    private:
+        NetworkReactor();
+        ~NetworkReactor();
+
+    public:
+        // onDone is posted to owner when the transfer ends; dropped if owner has gone.
+        void add(CURL *curl, std::weak_ptr<Batang::ThreadTaskPool> owner, CompletionHandler onDone);
+        void remove(CURL *curl); // waits until the reactor lets go of the handle; onDone is not called
+        CURLcode perform(CURL *curl); // blocking, like curl_easy_perform; not from the reactor thread
+        void resume(CURL *curl); // unpauses a transfer whose write callback returned CURL_WRITEFUNC_PAUSE
+        size_t transferCount() const;
+
+    private:
+        static int socketCallback(CURL *, curl_socket_t, int, void *, void *);
+        static int timerCallback(CURLM *, long, void *);
+
+    private:
+        void addTransfer(CURL *curl, CompletionHandler onDone);
+        void removeTransfer(CURL *curl);
+        void poll(SOCKET wakeSocket);
+        void checkDone();
+
+        friend class Batang::Singleton<NetworkReactor, Batang::DestructPriority::Fast, Batang::ExitBehavior::Skip>;
+        friend class Detail::ReactorThread;
+    };
+}
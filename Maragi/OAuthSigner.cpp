@@ -0,0 +1,196 @@
+﻿#include "Common.h"
+
+#include "../Batang/Base64.h"
+#include "../Batang/Singleton.h"
+#include "../Batang/Utility.h"
+
+#include "OAuthSigner.h"
+
+namespace Maragi
+{
+    namespace
+    {
+        class CryptProvider : public Batang::Singleton<CryptProvider, Batang::DestructPriority::Normal, Batang::ExitBehavior::Skip>
+        {
+        private:
+            HCRYPTPROV cp;
+
+        public:
+            CryptProvider(const wchar_t *containerName = nullptr)
+            {
+                if(!CryptAcquireContextW(&cp, containerName, nullptr, PROV_RSA_FULL, 0))
+                {
+                    if(GetLastError() == NTE_BAD_KEYSET)
+                    {
+                        if(!CryptAcquireContextW(&cp, containerName, nullptr, PROV_RSA_FULL, CRYPT_NEWKEYSET))
+                            throw(std::runtime_error("Cannot initialize pseudo-random number generator."));
+                    }
+                    else
+                        throw(std::runtime_error("Cannot initialize pseudo-random number generator."));
+                }
+            }
+
+            ~CryptProvider()
+            {
+                CryptReleaseContext(cp, 0);
+            }
+
+            HCRYPTPROV get()
+            {
+                return cp;
+            }
+        };
+
+        std::string toBase(unsigned long long num, int radix)
+        {
+            static const char digit[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+            std::string str;
+            do
+            {
+                str += digit[num % radix];
+                num /= radix;
+            }
+            while(num != 0);
+            return str;
+        }
+
+        std::string generateNonce()
+        {
+            static CryptProvider cp(L"MaragiPRNG");
+            unsigned long long rnd = 0;
+            if(!CryptGenRandom(cp.get(), sizeof(rnd), reinterpret_cast<uint8_t *>(&rnd)))
+                throw(std::runtime_error("Cannot generate pseudo-random number."));
+            return toBase(rnd, 62);
+        }
+
+        std::string currentTimestamp()
+        {
+            FILETIME ft;
+            GetSystemTimeAsFileTime(&ft);
+            unsigned long long ts = (static_cast<unsigned long long>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+            ts -= 116444736000000000;
+            ts /= 10000000;
+
+            return std::to_string(ts);
+        }
+    }
+
+    HmacSha1Key::HmacSha1Key()
+    {
+        assign(boost::string_view());
+    }
+
+    HmacSha1Key::HmacSha1Key(boost::string_view key)
+    {
+        assign(key);
+    }
+
+    void HmacSha1Key::assign(boost::string_view key)
+    {
+        const size_t BlockSize = 64;
+
+        uint8_t ipad[BlockSize] = {}, opad[BlockSize];
+        if(key.size() > BlockSize)
+            SHA1(reinterpret_cast<const uint8_t *>(key.data()), key.size(), ipad);
+        else
+            std::memcpy(ipad, key.data(), key.size());
+        std::memcpy(opad, ipad, BlockSize);
+
+        for(size_t i = 0; i < BlockSize; ++ i)
+        {
+            ipad[i] ^= 0x36;
+            opad[i] ^= 0x5C;
+        }
+
+        SHA1_Init(&inner_);
+        SHA1_Update(&inner_, ipad, BlockSize);
+        SHA1_Init(&outer_);
+        SHA1_Update(&outer_, opad, BlockSize);
+    }
+
+    void HmacSha1Key::digest(const void *message, size_t size, uint8_t (&out)[DigestSize]) const
+    {
+        SHA_CTX ctx = inner_;
+        SHA1_Update(&ctx, message, size);
+        SHA1_Final(out, &ctx);
+
+        ctx = outer_;
+        SHA1_Update(&ctx, out, DigestSize);
+        SHA1_Final(out, &ctx);
+    }
+
+    OAuthSigner::OAuthSigner(const std::string &consumerKey, const std::string &consumerSecret, const std::string &tokenSecret)
+        : consumerKey_(consumerKey)
+    {
+        std::string key = Batang::encodeUrl(consumerSecret);
+        key += "&";
+        Batang::encodeUrl(tokenSecret, key);
+        key_.assign(key);
+    }
+
+    std::string OAuthSigner::sign(Url &uri, const char *method)
+    {
+        std::string nonce = generateNonce();
+        sign(uri, method, currentTimestamp(), nonce);
+        return nonce;
+    }
+
+    void OAuthSigner::sign(Url &uri, const char *method, const std::string &timestamp, const std::string &nonce)
+    {
+        uri.setOAuthParam("oauth_consumer_key", consumerKey_);
+        uri.setOAuthParam("oauth_version", "1.0");
+        uri.setOAuthParam("oauth_timestamp", timestamp);
+        uri.setOAuthParam("oauth_nonce", nonce);
+        uri.setOAuthParam("oauth_signature_method", "HMAC-SHA1");
+
+        message_ = method;
+        message_ += "&";
+        Batang::encodeUrl(uri.baseUrl(), message_);
+        message_ += "&";
+
+        // RFC 5849 3.4.1.3.2: every name and value encoded, sorted by encoded name and then value, and
+        // a request parameter named as an oauth_ one kept beside it. Both encodings use RFC 3986 escaping,
+        // so a space is "%2520" in the base string rather than the '+' of a form body.
+        size_t count = 0;
+        auto normalize = [this, &count](const UrlParams::value_type &pair)
+        {
+            if(pair.first == "oauth_signature") // of an earlier signing; overwritten below
+                return;
+
+            if(count == encoded_.size())
+                encoded_.emplace_back();
+            auto &out = encoded_[count ++];
+            out.first.clear();
+            Batang::encodeUrl(pair.first, out.first);
+            out.second.clear();
+            Batang::encodeUrl(pair.second, out.second);
+        };
+        for(auto &pair: uri.params())
+            normalize(pair);
+        for(auto &pair: uri.oauthParams())
+            normalize(pair);
+        std::sort(encoded_.begin(), encoded_.begin() + count);
+
+        for(size_t i = 0; i < count; ++ i)
+        {
+            if(i > 0)
+                message_ += "%26"; // '&'
+            Batang::encodeUrl(encoded_[i].first, message_);
+            message_ += "%3D"; // '='
+            Batang::encodeUrl(encoded_[i].second, message_);
+        }
+
+        uint8_t digest[HmacSha1Key::DigestSize];
+        key_.digest(message_.data(), message_.size(), digest);
+        Batang::Base64Encoder encoder;
+        scratch_.clear();
+        encoder.encode(digest, sizeof(digest), scratch_);
+        encoder.finish(scratch_);
+        uri.setOAuthParam("oauth_signature", scratch_);
+    }
+
+    const std::string &OAuthSigner::baseString() const
+    {
+        return message_;
+    }
+}
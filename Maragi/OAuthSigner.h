@@ -0,0 +1,48 @@
+﻿#pragma once
+
+#include "Url.h"
+
+namespace Maragi
+{
+    // HMAC-SHA1 (RFC 2104) with the key folded in once: the hash states after the inner and outer padded
+    // keys are kept, so each digest hashes only the message and the inner digest.
+    class HmacSha1Key final
+    {
+    public:
+        static const size_t DigestSize = SHA_DIGEST_LENGTH;
+
+    private:
+        SHA_CTX inner_;
+        SHA_CTX outer_;
+
+    public:
+        HmacSha1Key();
+        explicit HmacSha1Key(boost::string_view key);
+
+    public:
+        void assign(boost::string_view key);
+        void digest(const void *, size_t, uint8_t (&out)[DigestSize]) const;
+    };
+
+    // Signs requests with HMAC-SHA1 as RFC 5849 lays out, for one consumer and token.
+    // The key is prepared when the signer is made, and the signature base string is built in one buffer
+    // kept across requests. Use a signer from one thread.
+    class OAuthSigner final
+    {
+    private:
+        std::string consumerKey_;
+        HmacSha1Key key_;
+        std::string message_; // signature base string
+        std::vector<std::pair<std::string, std::string>> encoded_; // parameters being normalized; the strings are reused
+        std::string scratch_;
+
+    public:
+        // An empty token secret is for requests made before a token is granted.
+        OAuthSigner(const std::string &consumerKey, const std::string &consumerSecret, const std::string &tokenSecret);
+
+    public:
+        std::string sign(Url &, const char *method = "POST"); // adds the oauth_ parameters and signature; returns the nonce
+        void sign(Url &, const char *method, const std::string &timestamp, const std::string &nonce);
+        const std::string &baseString() const; // of the last request signed
+    };
+}
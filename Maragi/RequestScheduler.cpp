@@ -0,0 +1,411 @@
+﻿#include "Common.h"
+
+#include "../Batang/Utility.h"
+
+#include "RequestScheduler.h"
+
+namespace Maragi
+{
+    namespace Detail
+    {
+        class SchedulerThread final : public Batang::Thread<SchedulerThread>
+        {
+        public:
+            virtual std::string name() const override
+            {
+                return "RequestScheduler";
+            }
+
+            void stop()
+            {
+                postQuitProcess();
+                join();
+            }
+
+        private:
+            void run()
+            {
+                pump();
+            }
+
+            friend class Batang::Thread<SchedulerThread>;
+        };
+    }
+
+    namespace
+    {
+        enum RateLimitHeaders
+        {
+            LimitHeader = 1 << 0,
+            RemainingHeader = 1 << 1,
+            ResetHeader = 1 << 2,
+        };
+
+        bool parseNumber(boost::string_view text, uint64_t &out)
+        {
+            if(text.empty() || text.size() > 19)
+                return false;
+
+            out = 0;
+            for(char ch: text)
+            {
+                if(ch < '0' || ch > '9')
+                    return false;
+                out = out * 10 + static_cast<uint64_t>(ch - '0');
+            }
+            return true;
+        }
+
+        // rhs in lower case
+        bool equalsIgnoreCase(boost::string_view lhs, boost::string_view rhs)
+        {
+            return lhs.size() == rhs.size()
+                && std::equal(lhs.begin(), lhs.end(), rhs.begin(), [](char l, char r) { return std::tolower(static_cast<uint8_t>(l)) == r; });
+        }
+
+        inline uint32_t clampCount(uint64_t value)
+        {
+            return static_cast<uint32_t>(std::min<uint64_t>(value, std::numeric_limits<uint32_t>::max()));
+        }
+    }
+
+    RateLimit::RateLimit()
+        : limit_(0)
+        , remaining_(0)
+        , reset_(0)
+        , seen_(0)
+    {
+    }
+
+    bool RateLimit::parseHeader(boost::string_view line)
+    {
+        size_t colon = line.find(':');
+        if(colon == boost::string_view::npos)
+            return false;
+
+        boost::string_view name = Batang::trimView(line.substr(0, colon));
+        uint64_t value;
+        if(!parseNumber(Batang::trimView(line.substr(colon + 1)), value))
+            return false;
+
+        if(equalsIgnoreCase(name, "x-rate-limit-limit"))
+        {
+            limit_ = clampCount(value);
+            seen_ |= LimitHeader;
+        }
+        else if(equalsIgnoreCase(name, "x-rate-limit-remaining"))
+        {
+            remaining_ = clampCount(value);
+            seen_ |= RemainingHeader;
+        }
+        else if(equalsIgnoreCase(name, "x-rate-limit-reset"))
+        {
+            reset_ = static_cast<int64_t>(value);
+            seen_ |= ResetHeader;
+        }
+        else
+            return false;
+
+        return true;
+    }
+
+    bool RateLimit::known() const
+    {
+        return seen_ == (LimitHeader | RemainingHeader | ResetHeader);
+    }
+
+    const std::chrono::seconds RequestScheduler::DefaultRetry(60);
+    const uint32_t RequestScheduler::ForegroundShare = 10;
+    const std::chrono::minutes RequestScheduler::RunTimeout(2);
+
+    RequestScheduler::RequestScheduler()
+        : newTicket_(1)
+        , stats_()
+    {
+        thread_.reset(new Detail::SchedulerThread());
+        thread_->start();
+    }
+
+    RequestScheduler::~RequestScheduler()
+    {
+        thread_->stop();
+        thread_ = nullptr;
+
+        // the thread has ended; what it left is safe to touch from here
+        for(auto &bucket: buckets_)
+            Batang::Timer::instance().uninstallTimer(bucket.second.timer_);
+    }
+
+    RequestScheduler::Ticket RequestScheduler::schedule(const std::string &token, const std::string &endpoint, Priority priority,
+        std::weak_ptr<Batang::ThreadTaskPool> owner, Task task)
+    {
+        if(priority < Foreground || priority >= PriorityCount)
+            throw(std::logic_error("RequestScheduler::schedule: invalid priority"));
+
+        Request request;
+        request.ticket_ = Ticket(newTicket_ ++);
+        request.key_ = token + "\n" + endpoint;
+        request.priority_ = priority;
+        request.owner_ = std::move(owner);
+        request.task_ = std::move(task);
+
+        Ticket ticket = request.ticket_;
+        auto shared = std::make_shared<Request>(std::move(request));
+        thread_->post([this, shared]() { enqueue(std::move(*shared), false); });
+        return ticket;
+    }
+
+    void RequestScheduler::finish(Ticket ticket, const RateLimit &rateLimit, long status)
+    {
+        thread_->post([this, ticket, rateLimit, status]() { complete(ticket, rateLimit, status); });
+    }
+
+    void RequestScheduler::cancel(Ticket ticket)
+    {
+        thread_->post([this, ticket]() { drop(ticket); });
+    }
+
+    void RequestScheduler::raise(Ticket ticket, Priority priority)
+    {
+        if(priority < Foreground || priority >= PriorityCount)
+            throw(std::logic_error("RequestScheduler::raise: invalid priority"));
+
+        thread_->post([this, ticket, priority]() { promote(ticket, priority); });
+    }
+
+    RequestScheduler::Stats RequestScheduler::stats() const
+    {
+        std::lock_guard<std::mutex> lock(statsMutex_);
+        return stats_;
+    }
+
+    void RequestScheduler::enqueue(Request request, bool first)
+    {
+        Bucket &bucket = buckets_[request.key_]; // a new one is zeroed, knowing nothing of its window
+        std::string key = request.key_;
+        queued_.emplace(request.ticket_, key);
+
+        auto &queue = bucket.queues_[request.priority_];
+        if(first)
+            queue.push_front(std::move(request));
+        else
+            queue.push_back(std::move(request));
+
+        dispatch(key);
+    }
+
+    void RequestScheduler::complete(Ticket ticket, const RateLimit &rateLimit, long status)
+    {
+        auto it = running_.find(ticket);
+        if(it == running_.end())
+            return;
+
+        Request request = std::move(it->second);
+        running_.erase(it);
+
+        Bucket &bucket = buckets_[request.key_];
+        -- bucket.inFlight_;
+
+        auto now = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::time_point resetAt = now + DefaultRetry;
+        if(rateLimit.seen_ & ResetHeader)
+        {
+            int64_t left = rateLimit.reset_ - static_cast<int64_t>(std::time(nullptr));
+            resetAt = now + std::chrono::seconds(std::max<int64_t>(left, 0) + 1); // the server clock rounds down
+        }
+
+        if(rateLimit.known())
+        {
+            // what the server counted may or may not include the others in flight; assume it does not
+            bucket.known_ = true;
+            bucket.limit_ = rateLimit.limit_;
+            bucket.remaining_ = rateLimit.remaining_ > bucket.inFlight_ ? rateLimit.remaining_ - bucket.inFlight_ : 0;
+            bucket.resetAt_ = resetAt;
+            bucket.nextAt_ = std::min(bucket.nextAt_, resetAt);
+        }
+
+        if(status == 429)
+        {
+            bucket.known_ = true;
+            bucket.remaining_ = 0;
+            bucket.resetAt_ = resetAt;
+            if(bucket.limit_ == 0)
+                bucket.limit_ = 1;
+
+            {
+                std::lock_guard<std::mutex> lock(statsMutex_);
+                ++ stats_.limited_;
+            }
+            enqueue(std::move(request), true);
+        }
+        else
+            dispatch(request.key_);
+    }
+
+    void RequestScheduler::drop(Ticket ticket)
+    {
+        auto it = queued_.find(ticket);
+        if(it == queued_.end())
+            return;
+
+        std::string key = std::move(it->second);
+        queued_.erase(it);
+
+        for(auto &queue: buckets_[key].queues_)
+        {
+            auto found = std::find_if(queue.begin(), queue.end(), [ticket](const Request &request) { return request.ticket_ == ticket; });
+            if(found != queue.end())
+            {
+                queue.erase(found);
+                break;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(statsMutex_);
+        ++ stats_.dropped_;
+    }
+
+    void RequestScheduler::promote(Ticket ticket, Priority priority)
+    {
+        auto it = queued_.find(ticket);
+        if(it == queued_.end())
+            return;
+
+        std::string key = it->second;
+        Bucket &bucket = buckets_[key];
+        for(int lower = priority + 1; lower < PriorityCount; ++ lower)
+        {
+            auto &queue = bucket.queues_[lower];
+            auto found = std::find_if(queue.begin(), queue.end(), [ticket](const Request &request) { return request.ticket_ == ticket; });
+            if(found == queue.end())
+                continue;
+
+            Request request = std::move(*found);
+            queue.erase(found);
+            request.priority_ = priority;
+            bucket.queues_[priority].push_back(std::move(request));
+            dispatch(key);
+            return;
+        }
+    }
+
+    void RequestScheduler::dispatch(const std::string &key)
+    {
+        Bucket &bucket = buckets_[key];
+        auto now = std::chrono::steady_clock::now();
+        auto timeoutAt = reclaim(key, bucket);
+
+        if(bucket.known_ && now >= bucket.resetAt_)
+            bucket.known_ = false; // a new window; the next response tells it
+
+        for(;;)
+        {
+            int priority = Foreground;
+            while(priority < PriorityCount && bucket.queues_[priority].empty())
+                ++ priority;
+            if(priority == PriorityCount)
+                break;
+
+            if(!bucket.known_)
+            {
+                if(bucket.inFlight_ > 0) // learning the window; complete() comes back here, or the time-out
+                {
+                    arm(key, bucket, timeoutAt);
+                    break;
+                }
+            }
+            else
+            {
+                uint32_t reserve = priority == Foreground ? 0 : bucket.limit_ / ForegroundShare;
+                if(bucket.remaining_ <= reserve)
+                {
+                    arm(key, bucket, bucket.resetAt_);
+                    break;
+                }
+                if(priority != Foreground && now < bucket.nextAt_)
+                {
+                    arm(key, bucket, bucket.nextAt_);
+                    break;
+                }
+
+                if(priority != Foreground)
+                    bucket.nextAt_ = now + (bucket.resetAt_ - now) / (bucket.remaining_ - reserve);
+                -- bucket.remaining_;
+            }
+
+            Request request = std::move(bucket.queues_[priority].front());
+            bucket.queues_[priority].pop_front();
+            queued_.erase(request.ticket_);
+
+            auto owner = request.owner_.lock();
+            if(!owner)
+            {
+                if(bucket.known_)
+                    ++ bucket.remaining_;
+
+                std::lock_guard<std::mutex> lock(statsMutex_);
+                ++ stats_.dropped_;
+                continue;
+            }
+
+            ++ bucket.inFlight_;
+            request.postedAt_ = now;
+            Ticket ticket = request.ticket_;
+            Task task = request.task_;
+            running_.emplace(ticket, std::move(request));
+            owner->post([task, ticket]() { task(ticket); });
+
+            std::lock_guard<std::mutex> lock(statsMutex_);
+            ++ stats_.dispatched_;
+        }
+    }
+
+    std::chrono::steady_clock::time_point RequestScheduler::reclaim(const std::string &key, Bucket &bucket)
+    {
+        auto now = std::chrono::steady_clock::now();
+        auto nextAt = std::chrono::steady_clock::time_point::max();
+        uint64_t abandoned = 0;
+        for(auto it = running_.begin(); it != running_.end(); )
+        {
+            const Request &request = it->second;
+            if(request.key_ != key)
+                ++ it;
+            else if(request.owner_.expired() || now >= request.postedAt_ + RunTimeout)
+            {
+                // its finish(), should it still come, finds nothing to complete
+                -- bucket.inFlight_;
+                ++ abandoned;
+                it = running_.erase(it);
+            }
+            else
+            {
+                nextAt = std::min(nextAt, request.postedAt_ + RunTimeout);
+                ++ it;
+            }
+        }
+
+        if(abandoned > 0)
+        {
+            std::lock_guard<std::mutex> lock(statsMutex_);
+            stats_.abandoned_ += abandoned;
+        }
+        return nextAt;
+    }
+
+    void RequestScheduler::arm(const std::string &key, Bucket &bucket, std::chrono::steady_clock::time_point at)
+    {
+        if(bucket.timer_ != Batang::Timer::TaskId() && bucket.timerAt_ <= at)
+            return;
+
+        Batang::Timer::instance().uninstallTimer(bucket.timer_);
+        bucket.timerAt_ = at;
+        bucket.timer_ = Batang::Timer::instance().installRunOnceTimer(thread_, at, [this, key]()
+        {
+            buckets_[key].timer_ = Batang::Timer::TaskId();
+            dispatch(key);
+        });
+
+        std::lock_guard<std::mutex> lock(statsMutex_);
+        ++ stats_.deferred_;
+    }
+}
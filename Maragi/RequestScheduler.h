@@ -0,0 +1,125 @@
+﻿#pragma once
+
+#include "../Batang/Singleton.h"
+#include "../Batang/Thread.h"
+#include "../Batang/Timer.h"
+#include "../Batang/Wrapper.h"
+
+namespace Maragi
+{
+    namespace Detail
+    {
+        class SchedulerThread;
+    }
+
+    // The rate limit window of an endpoint as a response reports it in x-rate-limit-* headers.
+    struct RateLimit
+    {
+        uint32_t limit_;
+        uint32_t remaining_;
+        int64_t reset_; // seconds since the epoch, UTC
+        uint32_t seen_; // bits of the headers parsed
+
+        RateLimit();
+
+        bool parseHeader(boost::string_view line); // false if the line is none of the three
+        bool known() const; // all three seen
+    };
+
+    // Holds REST requests back so that the columns and accounts sharing the API stay within its rate limits.
+    // Requests queue per access token and endpoint, each with a window learnt from the responses.
+    // A foreground request goes out while the window has quota left; the others are spread evenly over
+    // the rest of the window and leave 1/ForegroundShare of the limit to the foreground. Until a response
+    // tells the window, and again once it has run out, one request at a time goes out to learn it.
+    // A task runs on its owner's thread and must report its response to finish(), even if it failed.
+    // One whose owner has gone before finishing, or which has not finished in RunTimeout, is given up.
+    class RequestScheduler final : public Batang::Singleton<RequestScheduler, Batang::DestructPriority::Faster, Batang::ExitBehavior::Skip>
+    {
+    public:
+        enum Priority
+        {
+            Foreground, // a visible column
+            Background, // a hidden column
+            Idle, // prefetching and housekeeping
+            PriorityCount,
+        };
+
+        struct TicketTag {};
+        typedef Batang::ValueWrapper<size_t, TicketTag, 0> Ticket;
+        typedef std::function<void (Ticket)> Task;
+
+        struct Stats
+        {
+            uint64_t dispatched_;
+            uint64_t deferred_; // times a queue waited for quota or for its turn in the window
+            uint64_t limited_; // 429 responses; their requests were queued again
+            uint64_t dropped_; // canceled, or their owner had gone
+            uint64_t abandoned_; // posted but never finished; see RunTimeout
+        };
+
+    private:
+        struct Request
+        {
+            Ticket ticket_;
+            std::string key_;
+            Priority priority_;
+            std::weak_ptr<Batang::ThreadTaskPool> owner_;
+            Task task_;
+            std::chrono::steady_clock::time_point postedAt_;
+        };
+
+        struct Bucket
+        {
+            bool known_;
+            uint32_t limit_;
+            uint32_t remaining_; // what is in flight already taken off
+            uint32_t inFlight_;
+            std::chrono::steady_clock::time_point resetAt_;
+            std::chrono::steady_clock::time_point nextAt_; // the turn of the next paced request
+            std::deque<Request> queues_[PriorityCount];
+            Batang::Timer::TaskId timer_;
+            std::chrono::steady_clock::time_point timerAt_;
+        };
+
+    public:
+        static const std::chrono::seconds DefaultRetry; // after a 429 without a reset time
+        static const uint32_t ForegroundShare;
+        static const std::chrono::minutes RunTimeout;
+
+    private:
+        std::shared_ptr<Detail::SchedulerThread> thread_;
+        std::atomic<size_t> newTicket_;
+        mutable std::mutex statsMutex_;
+        Stats stats_;
+
+        // below are touched on the scheduler thread only
+        std::unordered_map<std::string, Bucket> buckets_;
+        std::unordered_map<Ticket, std::string> queued_; // to the bucket key
+        std::unordered_map<Ticket, Request> running_;
+
+    private:
+        RequestScheduler();
+        ~RequestScheduler();
+
+    public:
+        // task is posted to owner when its turn comes; dropped if owner has gone.
+        Ticket schedule(const std::string &token, const std::string &endpoint, Priority priority,
+            std::weak_ptr<Batang::ThreadTaskPool> owner, Task task);
+        void finish(Ticket, const RateLimit &, long status); // 429 queues the request again, first in line
+        void cancel(Ticket); // drops a request still queued; one already posted runs
+        void raise(Ticket, Priority); // moves a request still queued up to priority; one already posted runs as it is
+        Stats stats() const;
+
+    private:
+        void enqueue(Request request, bool first);
+        void complete(Ticket, const RateLimit &, long status);
+        void drop(Ticket);
+        void promote(Ticket, Priority);
+        void dispatch(const std::string &key);
+        std::chrono::steady_clock::time_point reclaim(const std::string &key, Bucket &); // returns when the next one times out
+        void arm(const std::string &key, Bucket &, std::chrono::steady_clock::time_point at);
+
+        friend class Batang::Singleton<RequestScheduler, Batang::DestructPriority::Faster, Batang::ExitBehavior::Skip>;
+        friend class Detail::SchedulerThread;
+    };
+}
@@ -0,0 +1,332 @@
+﻿#include "Common.h"
+
+#include "../Batang/Utility.h"
+
+#include "Json.h"
+#include "ResponseCache.h"
+#include "Utility.h"
+
+namespace Maragi
+{
+    const size_t ResponseCache::MemoryBudget = 4 * 1024 * 1024;
+    const size_t ResponseCache::DiskEntries = 256;
+
+    namespace
+    {
+        const uint32_t EntryMagic = 0x3152534D; // "MSR1"
+
+        // Followed by the key, the ETag, the Last-Modified date and the body.
+        struct EntryHeader
+        {
+            uint32_t magic_;
+            uint32_t keySize_;
+            uint32_t etagSize_;
+            uint32_t lastModifiedSize_;
+            uint64_t bodySize_;
+            uint64_t newestId_;
+        };
+        static_assert(sizeof(EntryHeader) == 32, "EntryHeader is a file format");
+
+        // endpoints which take since_id and answer with an array of statuses or messages, newest first
+        const char * const IncrementalEndpoints[] =
+        {
+            "statuses/home_timeline.json",
+            "statuses/user_timeline.json",
+            "statuses/mentions_timeline.json",
+            "statuses/retweets_of_me.json",
+            "favorites/list.json",
+            "lists/statuses.json",
+            "direct_messages.json",
+            "direct_messages/sent.json",
+        };
+
+        struct FileCloser
+        {
+            void operator ()(HANDLE file) const
+            {
+                if(file != INVALID_HANDLE_VALUE)
+                    CloseHandle(file);
+            }
+        };
+
+        typedef std::unique_ptr<void, FileCloser> FileHandle;
+
+        bool writeAll(HANDLE file, const void *data, size_t size)
+        {
+            ulong32_t written = 0;
+            return WriteFile(file, data, static_cast<ulong32_t>(size), &written, nullptr) && written == size;
+        }
+
+        bool equalsIgnoreCase(boost::string_view lhs, boost::string_view rhs)
+        {
+            return lhs.size() == rhs.size()
+                && std::equal(lhs.begin(), lhs.end(), rhs.begin(), [](char l, char r) { return std::tolower(static_cast<uint8_t>(l)) == r; });
+        }
+
+        bool endsWith(boost::string_view text, boost::string_view suffix)
+        {
+            return text.size() >= suffix.size() && text.substr(text.size() - suffix.size()) == suffix;
+        }
+
+        // FNV-1a; names the file of a key
+        uint64_t hashKey(boost::string_view key)
+        {
+            uint64_t hash = 14695981039346656037ull;
+            for(char ch: key)
+            {
+                hash ^= static_cast<uint8_t>(ch);
+                hash *= 1099511628211ull;
+            }
+            return hash;
+        }
+
+        // Appends the elements of a JSON array, raw, to out; false if the text is not an array.
+        bool arrayElements(const JsonDocument &doc, std::vector<boost::string_view> &out)
+        {
+            JsonValue root = doc.root();
+            if(root.type() != JsonValue::Array)
+                return false;
+            return root.forEach([&out](const JsonValue &value) { out.push_back(value.raw()); });
+        }
+    }
+
+    bool Validators::parseHeader(boost::string_view line)
+    {
+        size_t colon = line.find(':');
+        if(colon == boost::string_view::npos)
+            return false;
+
+        boost::string_view name = Batang::trimView(line.substr(0, colon));
+        boost::string_view value = Batang::trimView(line.substr(colon + 1));
+        if(value.empty())
+            return false;
+
+        if(equalsIgnoreCase(name, "etag"))
+            etag_.assign(value.data(), value.size());
+        else if(equalsIgnoreCase(name, "last-modified"))
+            lastModified_.assign(value.data(), value.size());
+        else
+            return false;
+
+        return true;
+    }
+
+    bool Validators::empty() const
+    {
+        return etag_.empty() && lastModified_.empty();
+    }
+
+    ResponseCache::ResponseCache(const std::wstring &name, size_t budget)
+        : budget_(budget)
+        , memorySize_(0)
+        , stats_()
+    {
+        if(name.empty())
+            return;
+
+        // a data directory which cannot be made or listed leaves the cache to memory
+        boost::system::error_code listError;
+        directory_ = getDataDirectoryPath() + L"Cache\\Responses\\" + name + L"\\";
+        boost::filesystem::create_directories(directory_, listError);
+        if(listError)
+        {
+            directory_.clear();
+            return;
+        }
+
+        std::vector<std::pair<std::time_t, boost::filesystem::path>> files;
+        boost::filesystem::directory_iterator end;
+        for(boost::filesystem::directory_iterator it(directory_, listError); !listError && it != end; it.increment(listError))
+        {
+            const auto &path = it->path();
+            boost::system::error_code ec;
+            if(path.extension() == L".tmp") // a write cut short
+                boost::filesystem::remove(path, ec);
+            else if(path.extension() == L".rsp")
+            {
+                std::time_t time = boost::filesystem::last_write_time(path, ec);
+                if(!ec)
+                    files.emplace_back(time, path);
+            }
+        }
+
+        if(files.size() > DiskEntries)
+        {
+            std::sort(files.begin(), files.end());
+            for(size_t i = 0; i < files.size() - DiskEntries; ++ i)
+            {
+                boost::system::error_code ec;
+                boost::filesystem::remove(files[i].second, ec);
+            }
+        }
+    }
+
+    bool ResponseCache::incremental(boost::string_view baseUrl)
+    {
+        return std::any_of(std::begin(IncrementalEndpoints), std::end(IncrementalEndpoints),
+            [baseUrl](const char *endpoint) { return endsWith(baseUrl, endpoint); });
+    }
+
+    bool ResponseCache::mergeTimeline(boost::string_view fresh, boost::string_view cached, size_t count, std::string &out)
+    {
+        JsonDocument freshDoc, cachedDoc;
+        std::vector<boost::string_view> elements;
+        if(!freshDoc.parse(fresh) || !arrayElements(freshDoc, elements))
+            return false;
+
+        size_t freshCount = elements.size();
+        if(freshCount < count) // otherwise statuses between the two may be missing; the fresh ones replace the cached
+        {
+            if(!cachedDoc.parse(cached) || !arrayElements(cachedDoc, elements))
+                return false;
+        }
+        elements.resize(std::min(elements.size(), std::max(count, freshCount)));
+
+        out.clear();
+        out.push_back('[');
+        for(size_t i = 0; i < elements.size(); ++ i)
+        {
+            if(i > 0)
+                out.push_back(',');
+            out.append(elements[i].data(), elements[i].size());
+        }
+        out.push_back(']');
+        return true;
+    }
+
+    uint64_t ResponseCache::newestId(boost::string_view body)
+    {
+        JsonDocument doc;
+        if(!doc.parse(body) || doc.root().type() != JsonValue::Array)
+            return 0;
+
+        uint64_t id = 0;
+        bool first = true;
+        doc.root().forEach([&id, &first](const JsonValue &value)
+        {
+            JsonValue idValue;
+            if(first && value.find("id", idValue))
+                idValue.getUint64(id);
+            first = false;
+        });
+        return id;
+    }
+
+    std::shared_ptr<const ResponseCache::Entry> ResponseCache::find(const std::string &key)
+    {
+        auto it = index_.find(key);
+        if(it != index_.end())
+        {
+            entries_.splice(entries_.begin(), entries_, it->second);
+            ++ stats_.memoryHits_;
+            return it->second->second;
+        }
+
+        if(directory_.empty())
+        {
+            ++ stats_.misses_;
+            return nullptr;
+        }
+
+        FileHandle file(CreateFileW(entryPath(key).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+        EntryHeader header;
+        ulong32_t read = 0;
+        LARGE_INTEGER size;
+        if(file.get() == INVALID_HANDLE_VALUE || !GetFileSizeEx(file.get(), &size)
+            || !ReadFile(file.get(), &header, sizeof(header), &read, nullptr) || read != sizeof(header) || header.magic_ != EntryMagic
+            || sizeof(header) + static_cast<uint64_t>(header.keySize_) + header.etagSize_ + header.lastModifiedSize_ + header.bodySize_
+                != static_cast<uint64_t>(size.QuadPart))
+        {
+            ++ stats_.misses_;
+            return nullptr;
+        }
+
+        std::vector<char> data(static_cast<size_t>(size.QuadPart - sizeof(header)));
+        if(!ReadFile(file.get(), data.data(), static_cast<ulong32_t>(data.size()), &read, nullptr) || read != data.size()
+            || boost::string_view(data.data(), header.keySize_) != key) // another key with the same hash
+        {
+            ++ stats_.misses_;
+            return nullptr;
+        }
+
+        auto entry = std::make_shared<Entry>();
+        const char *p = data.data() + header.keySize_;
+        entry->validators_.etag_.assign(p, header.etagSize_);
+        p += header.etagSize_;
+        entry->validators_.lastModified_.assign(p, header.lastModifiedSize_);
+        p += header.lastModifiedSize_;
+        entry->body_.assign(p, static_cast<size_t>(header.bodySize_));
+        entry->newestId_ = header.newestId_;
+
+        remember(key, entry);
+        ++ stats_.diskHits_;
+        return entry;
+    }
+
+    void ResponseCache::store(const std::string &key, std::shared_ptr<const Entry> entry)
+    {
+        remember(key, entry);
+        ++ stats_.stored_;
+
+        if(directory_.empty())
+            return;
+
+        EntryHeader header = {EntryMagic, static_cast<uint32_t>(key.size()), static_cast<uint32_t>(entry->validators_.etag_.size()),
+            static_cast<uint32_t>(entry->validators_.lastModified_.size()), entry->body_.size(), entry->newestId_};
+
+        // written aside and renamed over, so a reader never sees half an entry
+        std::wstring path = entryPath(key), tempPath = path + L".tmp";
+        bool written;
+        {
+            FileHandle file(CreateFileW(tempPath.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr));
+            written = file.get() != INVALID_HANDLE_VALUE
+                && writeAll(file.get(), &header, sizeof(header))
+                && writeAll(file.get(), key.data(), key.size())
+                && writeAll(file.get(), entry->validators_.etag_.data(), entry->validators_.etag_.size())
+                && writeAll(file.get(), entry->validators_.lastModified_.data(), entry->validators_.lastModified_.size())
+                && writeAll(file.get(), entry->body_.data(), entry->body_.size());
+        }
+
+        boost::system::error_code ec;
+        if(written)
+            boost::filesystem::rename(tempPath, path, ec);
+        else
+            boost::filesystem::remove(tempPath, ec);
+    }
+
+    const ResponseCache::Stats &ResponseCache::stats() const
+    {
+        return stats_;
+    }
+
+    void ResponseCache::remember(const std::string &key, std::shared_ptr<const Entry> entry)
+    {
+        auto it = index_.find(key);
+        if(it != index_.end())
+        {
+            memorySize_ -= it->second->second->body_.size();
+            entries_.erase(it->second);
+            index_.erase(it);
+        }
+
+        memorySize_ += entry->body_.size();
+        entries_.emplace_front(key, std::move(entry));
+        index_.emplace(key, entries_.begin());
+
+        // the newest entry stays even if it alone is over the budget
+        while(memorySize_ > budget_ && entries_.size() > 1)
+        {
+            memorySize_ -= entries_.back().second->body_.size();
+            index_.erase(entries_.back().first);
+            entries_.pop_back();
+            ++ stats_.evicted_;
+        }
+    }
+
+    std::wstring ResponseCache::entryPath(const std::string &key) const
+    {
+        wchar_t name[17];
+        swprintf(name, 17, L"%016llx", static_cast<unsigned long long>(hashKey(key)));
+        return directory_ + name + L".rsp";
+    }
+}
@@ -0,0 +1,79 @@
+﻿#pragma once
+
+namespace Maragi
+{
+    // Validators of one response, picked out of its header lines as they arrive.
+    struct Validators
+    {
+        std::string etag_;
+        std::string lastModified_;
+
+        bool parseHeader(boost::string_view line); // false if the line is not a validator
+        bool empty() const;
+    };
+
+    // Recent GET responses of one account, so a refresh can revalidate them with If-None-Match and
+    // If-Modified-Since, or fetch only the statuses newer than the cached ones, instead of downloading
+    // them again. Keyed by the composed URL; the newest entries are kept in memory up to MemoryBudget
+    // bytes and every entry on disk in getDataDirectoryPath()\Cache\Responses\<name>\, the oldest
+    // files beyond DiskEntries being removed on construction. An empty name, or a directory which
+    // cannot be made, keeps to memory.
+    // Used from one thread.
+    class ResponseCache final
+    {
+    public:
+        struct Entry
+        {
+            std::string body_;
+            Validators validators_;
+            uint64_t newestId_; // of the first status of a timeline response; 0 for other responses
+        };
+
+        struct Stats
+        {
+            uint64_t memoryHits_;
+            uint64_t diskHits_;
+            uint64_t misses_;
+            uint64_t stored_; // entries, in memory and on disk
+            uint64_t evicted_; // from memory
+        };
+
+    private:
+        typedef std::list<std::pair<std::string, std::shared_ptr<const Entry>>> EntryList;
+
+    public:
+        static const size_t MemoryBudget;
+        static const size_t DiskEntries;
+
+    private:
+        std::wstring directory_;
+        size_t budget_;
+        size_t memorySize_; // bodies in entries_
+        EntryList entries_; // most recently used first
+        std::unordered_map<std::string, EntryList::iterator> index_;
+        Stats stats_;
+
+    public:
+        explicit ResponseCache(const std::wstring &name, size_t budget = MemoryBudget);
+
+    private:
+        ResponseCache(const ResponseCache &) = delete;
+        ResponseCache &operator =(const ResponseCache &) = delete;
+
+    public:
+        // Whether the endpoint pages by since_id, so a refresh can ask for newer statuses only.
+        static bool incremental(boost::string_view baseUrl);
+        // Newest statuses first, then the cached ones, up to count; false if either is not a status array.
+        static bool mergeTimeline(boost::string_view fresh, boost::string_view cached, size_t count, std::string &out);
+        static uint64_t newestId(boost::string_view body); // 0 if the body is not a status array or is empty
+
+    public:
+        std::shared_ptr<const Entry> find(const std::string &key); // null if neither memory nor disk has it
+        void store(const std::string &key, std::shared_ptr<const Entry>); // kept in memory even if the file cannot be written
+        const Stats &stats() const;
+
+    private:
+        void remember(const std::string &key, std::shared_ptr<const Entry>);
+        std::wstring entryPath(const std::string &key) const;
+    };
+}
@@ -0,0 +1,139 @@
+﻿#include "Common.h"
+
+#include "../Batang/Utility.h"
+
+#include "StreamFramer.h"
+
+namespace Maragi
+{
+    const size_t StreamFramer::DefaultMaxMessageSize = 1024 * 1024;
+
+    namespace
+    {
+        // The length line before a message with delimited=length; false for anything else.
+        bool parseLength(boost::string_view line, size_t &out)
+        {
+            if(line.empty() || line.size() > 9)
+                return false;
+
+            out = 0;
+            for(char ch: line)
+            {
+                if(ch < '0' || ch > '9')
+                    return false;
+                out = out * 10 + static_cast<size_t>(ch - '0');
+            }
+            return true;
+        }
+
+        void emit(boost::string_view message, const std::function<void (boost::string_view)> &fn)
+        {
+            message = Batang::trimView(message); // the CR, and whole keep-alive lines
+            if(!message.empty())
+                fn(message);
+        }
+    }
+
+    StreamFramer::StreamFramer(size_t maxMessageSize)
+        : maxMessageSize_(maxMessageSize)
+        , discarding_(false)
+        , expected_(0)
+        , discardedCount_(0)
+    {
+    }
+
+    void StreamFramer::feed(const char *data, size_t size, const std::function<void (boost::string_view)> &fn)
+    {
+        const char *p = data, *end = data + size;
+
+        while(p != end)
+        {
+            if(expected_ > 0)
+            {
+                size_t take = std::min<size_t>(expected_, end - p);
+                expected_ -= take;
+                if(discarding_)
+                    discarding_ = expected_ > 0;
+                else if(expected_ == 0 && buffer_.empty()) // a message within one chunk is handed out in place
+                    emit(boost::string_view(p, take), fn);
+                else
+                {
+                    buffer_.append(p, take);
+                    if(expected_ == 0)
+                    {
+                        emit(buffer_, fn);
+                        buffer_.clear();
+                    }
+                }
+                p += take;
+                continue;
+            }
+
+            auto newline = static_cast<const char *>(std::memchr(p, '\n', end - p));
+            const char *lineEnd = newline ? newline : end;
+            const char *next = newline ? newline + 1 : end;
+
+            if(discarding_)
+            {
+                discarding_ = !newline;
+                p = next;
+                continue;
+            }
+
+            if(buffer_.size() + (lineEnd - p) > maxMessageSize_)
+            {
+                buffer_.clear();
+                ++ discardedCount_;
+                discarding_ = !newline;
+                p = next;
+                continue;
+            }
+
+            if(!newline)
+            {
+                buffer_.append(p, end);
+                break;
+            }
+
+            // a message within one chunk is handed out in place
+            boost::string_view message(p, newline - p);
+            if(!buffer_.empty())
+            {
+                buffer_.append(p, newline);
+                message = buffer_;
+            }
+            p = next;
+
+            size_t length;
+            if(parseLength(Batang::trimView(message), length))
+            {
+                expected_ = length;
+                if(length > maxMessageSize_)
+                {
+                    ++ discardedCount_;
+                    discarding_ = true;
+                }
+            }
+            else
+                emit(message, fn);
+            buffer_.clear();
+        }
+    }
+
+    void StreamFramer::reset()
+    {
+        buffer_.clear();
+        discarding_ = false;
+        expected_ = 0;
+    }
+
+    size_t StreamFramer::bufferedSize() const
+    {
+        return buffer_.size();
+    }
+
+    size_t StreamFramer::discardedCount() const
+    {
+        return discardedCount_;
+    }
+}
@@ -0,0 +1,33 @@
+﻿#pragma once
+
+namespace Maragi
+{
+    // Cuts the body of a streaming API connection, fed in arbitrary chunks, into messages.
+    // Messages end with CRLF and blank keep-alive lines are skipped. A line of digits alone, as sent with
+    // delimited=length, gives the size of the message after it, which is then taken by count.
+    // A message growing beyond the limit is thrown away up to its delimiter or its count, so a connection
+    // never buffers more than that.
+    class StreamFramer final
+    {
+    public:
+        static const size_t DefaultMaxMessageSize;
+
+    private:
+        std::string buffer_; // head of a message split across chunks
+        size_t maxMessageSize_;
+        bool discarding_;
+        size_t expected_; // bytes left of a message whose length was given
+        size_t discardedCount_;
+
+    public:
+        explicit StreamFramer(size_t = DefaultMaxMessageSize);
+
+    public:
+        // Calls fn with each completed message; views are valid during the call only.
+        void feed(const char *, size_t, const std::function<void (boost::string_view)> &fn);
+        void reset(); // drops a partial message, as when the connection is replaced
+
+        size_t bufferedSize() const;
+        size_t discardedCount() const;
+    };
+}
@@ -0,0 +1,304 @@
+﻿#include "Common.h"
+
+#include "TimelineStore.h"
+
+namespace Maragi
+{
+    namespace
+    {
+        const size_t RepackRatio = 4; // a batch with no more than 1 / RepackRatio of its tweets live is repacked
+    }
+
+    TimelineStore::TimelineStore()
+        : newColumnId_(1)
+    {
+    }
+
+    TimelineStore::~TimelineStore()
+    {
+    }
+
+    TimelineStore::ColumnId TimelineStore::createColumn()
+    {
+        ColumnId id = newColumnId_;
+        newColumnId_ = ColumnId(*newColumnId_ + 1);
+        columns_.emplace(id, Column());
+        return id;
+    }
+
+    void TimelineStore::removeColumn(ColumnId columnId)
+    {
+        auto it = columns_.find(columnId);
+        if(it == columns_.end())
+            return;
+
+        for(uint32_t slot: it->second.slots_)
+            releaseSlot(slot);
+        columns_.erase(it);
+    }
+
+    bool TimelineStore::insert(ColumnId columnId, const std::shared_ptr<const TweetBatch> &batch, const TweetRecord &tweet)
+    {
+        Column &col = column(columnId);
+
+        auto pos = std::lower_bound(col.ids_.begin(), col.ids_.end(), tweet.id_);
+        if(pos != col.ids_.end() && *pos == tweet.id_)
+            return false;
+
+        uint32_t slot = acquireSlot(batch, tweet);
+        col.slots_.insert(col.slots_.begin() + (pos - col.ids_.begin()), slot);
+        col.ids_.insert(pos, tweet.id_);
+        return true;
+    }
+
+    size_t TimelineStore::insert(ColumnId columnId, const std::shared_ptr<const TweetBatch> &batch)
+    {
+        size_t added = 0;
+        for(auto &tweet: batch->tweets())
+        {
+            if(insert(columnId, batch, tweet))
+                ++ added;
+        }
+        return added;
+    }
+
+    bool TimelineStore::remove(ColumnId columnId, uint64_t id)
+    {
+        Column &col = column(columnId);
+
+        auto pos = std::lower_bound(col.ids_.begin(), col.ids_.end(), id);
+        if(pos == col.ids_.end() || *pos != id)
+            return false;
+
+        auto slot = col.slots_.begin() + (pos - col.ids_.begin());
+        releaseSlot(*slot);
+        col.slots_.erase(slot);
+        col.ids_.erase(pos);
+        return true;
+    }
+
+    void TimelineStore::trim(ColumnId columnId, size_t maxSize)
+    {
+        Column &col = column(columnId);
+        if(col.ids_.size() <= maxSize)
+            return;
+
+        size_t drop = col.ids_.size() - maxSize;
+        for(size_t i = 0; i < drop; ++ i)
+            releaseSlot(col.slots_[i]);
+        col.slots_.erase(col.slots_.begin(), col.slots_.begin() + drop);
+        col.ids_.erase(col.ids_.begin(), col.ids_.begin() + drop);
+    }
+
+    size_t TimelineStore::columnSize(ColumnId columnId) const
+    {
+        return column(columnId).ids_.size();
+    }
+
+    size_t TimelineStore::uniqueCount() const
+    {
+        return slotOf_.size();
+    }
+
+    const TweetRecord *TimelineStore::find(uint64_t id) const
+    {
+        auto it = slotOf_.find(id);
+        if(it == slotOf_.end())
+            return nullptr;
+        return records_[it->second];
+    }
+
+    void TimelineStore::page(ColumnId columnId, size_t offset, size_t count, std::vector<const TweetRecord *> &out) const
+    {
+        const Column &col = column(columnId);
+        if(offset >= col.slots_.size())
+            return;
+
+        auto end = col.slots_.rend();
+        for(auto it = col.slots_.rbegin() + offset; it != end && count > 0; ++ it, -- count)
+            out.push_back(records_[*it]);
+    }
+
+    void TimelineStore::filter(ColumnId columnId, const Filter &filter, size_t count, std::vector<const TweetRecord *> &out) const
+    {
+        const Column &col = column(columnId);
+
+        for(auto it = col.slots_.rbegin(); it != col.slots_.rend() && count > 0; ++ it)
+        {
+            uint32_t slot = *it;
+            if(createdAt_[slot] < filter.since_) // ids follow time, so the rest are older still
+                break;
+            if((flags_[slot] & filter.flagMask_) != filter.flags_)
+                continue;
+            if(filter.authorId_ != 0 && authors_[slot] != filter.authorId_)
+                continue;
+
+            out.push_back(records_[slot]);
+            -- count;
+        }
+    }
+
+    void TimelineStore::merge(const std::vector<ColumnId> &columnIds, size_t count, std::vector<const TweetRecord *> &out) const
+    {
+        // k-way merge from the newest ends; a heap of (id, column) keeps it O(log k) per tweet
+        std::vector<const Column *> cols;
+        std::vector<size_t> left; // entries not merged yet, per column
+        std::vector<std::pair<uint64_t, size_t>> heap;
+
+        for(auto columnId: columnIds)
+        {
+            const Column &col = column(columnId);
+            if(col.ids_.empty())
+                continue;
+            heap.emplace_back(col.ids_.back(), cols.size());
+            cols.push_back(&col);
+            left.push_back(col.ids_.size());
+        }
+        std::make_heap(heap.begin(), heap.end());
+
+        uint64_t last = 0;
+        bool any = false;
+        while(!heap.empty() && count > 0)
+        {
+            std::pop_heap(heap.begin(), heap.end());
+            auto top = heap.back();
+            heap.pop_back();
+
+            const Column &col = *cols[top.second];
+            size_t &remaining = left[top.second];
+            if(!any || top.first != last)
+            {
+                out.push_back(records_[col.slots_[remaining - 1]]);
+                last = top.first;
+                any = true;
+                -- count;
+            }
+
+            if(-- remaining > 0)
+            {
+                heap.emplace_back(col.ids_[remaining - 1], top.second);
+                std::push_heap(heap.begin(), heap.end());
+            }
+        }
+    }
+
+    uint32_t TimelineStore::acquireSlot(const std::shared_ptr<const TweetBatch> &batch, const TweetRecord &tweet)
+    {
+        auto found = slotOf_.find(tweet.id_);
+        if(found != slotOf_.end())
+        {
+            ++ refs_[found->second];
+            return found->second;
+        }
+
+        uint32_t batchIndex;
+        auto batchIt = batchIndex_.find(batch.get());
+        if(batchIt != batchIndex_.end())
+            batchIndex = batchIt->second;
+        else
+        {
+            Batch entry = { batch, 0 };
+            if(freeBatches_.empty())
+            {
+                batchIndex = static_cast<uint32_t>(batches_.size());
+                batches_.push_back(std::move(entry));
+            }
+            else
+            {
+                batchIndex = freeBatches_.back();
+                freeBatches_.pop_back();
+                batches_[batchIndex] = std::move(entry);
+            }
+            batchIndex_.emplace(batch.get(), batchIndex);
+        }
+        ++ batches_[batchIndex].live_;
+
+        uint32_t slot;
+        if(freeSlots_.empty())
+        {
+            slot = static_cast<uint32_t>(ids_.size());
+            ids_.push_back(0);
+            createdAt_.push_back(0);
+            authors_.push_back(0);
+            flags_.push_back(0);
+            records_.push_back(nullptr);
+            batchOf_.push_back(0);
+            refs_.push_back(0);
+        }
+        else
+        {
+            slot = freeSlots_.back();
+            freeSlots_.pop_back();
+        }
+
+        ids_[slot] = tweet.id_;
+        createdAt_[slot] = tweet.createdAt_;
+        authors_[slot] = tweet.user_->id_;
+        flags_[slot] = tweet.flags_;
+        records_[slot] = &tweet;
+        batchOf_[slot] = batchIndex;
+        refs_[slot] = 1;
+        slotOf_.emplace(tweet.id_, slot);
+        return slot;
+    }
+
+    void TimelineStore::releaseSlot(uint32_t slot)
+    {
+        if(-- refs_[slot] > 0)
+            return;
+
+        slotOf_.erase(ids_[slot]);
+        records_[slot] = nullptr;
+        freeSlots_.push_back(slot);
+
+        Batch &batch = batches_[batchOf_[slot]];
+        if(-- batch.live_ == 0)
+        {
+            batchIndex_.erase(batch.batch_.get());
+            batch.batch_ = nullptr; // lets the arena go
+            freeBatches_.push_back(batchOf_[slot]);
+        }
+        else if(batch.live_ <= batch.batch_->size() / RepackRatio)
+            repack(batchOf_[slot]);
+    }
+
+    void TimelineStore::repack(uint32_t batchIndex)
+    {
+        Batch &batch = batches_[batchIndex];
+        auto packed = std::make_shared<TweetBatch>();
+        std::vector<uint32_t> slots;
+
+        for(auto &tweet: batch.batch_->tweets())
+        {
+            auto found = slotOf_.find(tweet.id_);
+            if(found == slotOf_.end() || records_[found->second] != &tweet)
+                continue;
+            packed->add(tweet, batch.batch_->user(tweet), batch.batch_->entities(tweet));
+            slots.push_back(found->second);
+        }
+        packed->compact();
+
+        for(size_t i = 0; i < slots.size(); ++ i)
+            records_[slots[i]] = &packed->tweets()[i];
+
+        batchIndex_.erase(batch.batch_.get());
+        batchIndex_.emplace(packed.get(), batchIndex);
+        batch.batch_ = std::move(packed);
+    }
+
+    TimelineStore::Column &TimelineStore::column(ColumnId columnId)
+    {
+        auto it = columns_.find(columnId);
+        if(it == columns_.end())
+            throw(std::logic_error("TimelineStore: no such column"));
+        return it->second;
+    }
+
+    const TimelineStore::Column &TimelineStore::column(ColumnId columnId) const
+    {
+        auto it = columns_.find(columnId);
+        if(it == columns_.end())
+            throw(std::logic_error("TimelineStore: no such column"));
+        return it->second;
+    }
+}
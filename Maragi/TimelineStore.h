@@ -0,0 +1,96 @@
+﻿#pragma once
+
+#include "../Batang/Singleton.h"
+#include "../Batang/Wrapper.h"
+
+#include "Tweet.h"
+
+namespace Maragi
+{
+    // Every tweet shown anywhere, held once however many columns show it.
+    // The store keeps one slot per unique tweet with its hot fields in parallel arrays, so filtering
+    // and merging read a few flat vectors instead of records. A column is a list of slots sorted by
+    // id, oldest first: a streamed tweet is nearly always newer than the rest and lands at the end,
+    // and anything else costs a binary search and a move of the newer entries.
+    // A batch is held while any of its tweets is; once no more than a quarter of them are left, those are
+    // copied into a batch of their own so the rest of the arena goes. Records therefore stay valid until
+    // the next remove(), trim() or removeColumn(). Use the store from one thread, the UI one: a column is fed
+    // with the batches of TwitterClient::onHomeRestored and onStreamBatch, posted over from the client thread.
+    class TimelineStore final : public Batang::Singleton<TimelineStore, Batang::DestructPriority::Normal, Batang::ExitBehavior::Skip>
+    {
+    public:
+        struct ColumnIdTag {};
+        typedef Batang::ValueWrapper<size_t, ColumnIdTag, 0> ColumnId;
+
+        struct Filter
+        {
+            uint32_t flagMask_; // tweets whose flags_ & flagMask_ equals flags_
+            uint32_t flags_;
+            uint64_t authorId_; // 0 for anyone
+            int64_t since_; // created at or after; 0 for any time
+        };
+
+    private:
+        struct Batch
+        {
+            std::shared_ptr<const TweetBatch> batch_;
+            size_t live_; // slots taken from it
+        };
+
+        struct Column
+        {
+            std::vector<uint64_t> ids_; // ascending; searched without touching the slots
+            std::vector<uint32_t> slots_;
+        };
+
+    private:
+        // per slot
+        std::vector<uint64_t> ids_;
+        std::vector<int64_t> createdAt_;
+        std::vector<uint64_t> authors_;
+        std::vector<uint32_t> flags_;
+        std::vector<const TweetRecord *> records_;
+        std::vector<uint32_t> batchOf_;
+        std::vector<uint32_t> refs_; // columns holding the slot; 0 when free
+        std::vector<uint32_t> freeSlots_;
+        std::unordered_map<uint64_t, uint32_t> slotOf_;
+
+        std::vector<Batch> batches_;
+        std::vector<uint32_t> freeBatches_;
+        std::unordered_map<const TweetBatch *, uint32_t> batchIndex_;
+
+        ColumnId newColumnId_;
+        std::unordered_map<ColumnId, Column> columns_;
+
+    private:
+        TimelineStore();
+        ~TimelineStore();
+
+    public:
+        ColumnId createColumn();
+        void removeColumn(ColumnId);
+
+        bool insert(ColumnId, const std::shared_ptr<const TweetBatch> &, const TweetRecord &); // false if already there
+        size_t insert(ColumnId, const std::shared_ptr<const TweetBatch> &); // returns how many were new to the column
+        bool remove(ColumnId, uint64_t id);
+        void trim(ColumnId, size_t maxSize); // drops the oldest beyond maxSize
+
+        size_t columnSize(ColumnId) const;
+        size_t uniqueCount() const;
+        const TweetRecord *find(uint64_t id) const;
+
+        // The following list newest first.
+        void page(ColumnId, size_t offset, size_t count, std::vector<const TweetRecord *> &out) const;
+        void filter(ColumnId, const Filter &, size_t count, std::vector<const TweetRecord *> &out) const;
+        void merge(const std::vector<ColumnId> &, size_t count, std::vector<const TweetRecord *> &out) const; // each tweet once
+
+    private:
+        uint32_t acquireSlot(const std::shared_ptr<const TweetBatch> &, const TweetRecord &);
+        void releaseSlot(uint32_t);
+        void repack(uint32_t batchIndex);
+        Column &column(ColumnId);
+        const Column &column(ColumnId) const;
+
+        friend class Batang::Singleton<TimelineStore, Batang::DestructPriority::Normal, Batang::ExitBehavior::Skip>;
+    };
+}
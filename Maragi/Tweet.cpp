@@ -0,0 +1,407 @@
+﻿#include "Common.h"
+
+#include "../Batang/ChunkBuffer.h"
+
+#include "Json.h"
+#include "Tweet.h"
+
+namespace Maragi
+{
+    namespace
+    {
+        // days since 1970-01-01 of a proleptic Gregorian date; Howard Hinnant's days_from_civil
+        int64_t daysFromCivil(int64_t year, unsigned month, unsigned day)
+        {
+            year -= month <= 2;
+            int64_t era = (year >= 0 ? year : year - 399) / 400;
+            unsigned yearOfEra = static_cast<unsigned>(year - era * 400);
+            unsigned dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+            unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+            return era * 146097 + static_cast<int64_t>(dayOfEra) - 719468;
+        }
+
+        bool readDigits(boost::string_view text, size_t pos, size_t count, int &out)
+        {
+            out = 0;
+            for(size_t i = pos; i < pos + count; ++ i)
+            {
+                if(text[i] < '0' || text[i] > '9')
+                    return false;
+                out = out * 10 + (text[i] - '0');
+            }
+            return true;
+        }
+
+        // "Wed Oct 10 20:19:24 +0000 2018"
+        bool parseCreatedAt(boost::string_view text, int64_t &out)
+        {
+            static const boost::string_view months("JanFebMarAprMayJunJulAugSepOctNovDec");
+
+            if(text.size() != 30 || (text[20] != '+' && text[20] != '-'))
+                return false;
+
+            size_t month = months.find(text.substr(4, 3));
+            if(month == boost::string_view::npos || month % 3 != 0)
+                return false;
+
+            int day, hour, minute, second, offsetHour, offsetMinute, year;
+            if(!readDigits(text, 8, 2, day) || !readDigits(text, 11, 2, hour) || !readDigits(text, 14, 2, minute)
+                || !readDigits(text, 17, 2, second) || !readDigits(text, 21, 2, offsetHour) || !readDigits(text, 23, 2, offsetMinute)
+                || !readDigits(text, 26, 4, year))
+                return false;
+
+            int offset = (offsetHour * 3600 + offsetMinute * 60) * (text[20] == '-' ? -1 : 1);
+            out = daysFromCivil(year, static_cast<unsigned>(month / 3 + 1), static_cast<unsigned>(day)) * 86400
+                + hour * 3600 + minute * 60 + second - offset;
+            return true;
+        }
+
+        size_t utf16Length(boost::string_view utf8)
+        {
+            size_t length = 0;
+            for(char ch: utf8)
+            {
+                uint8_t byte = static_cast<uint8_t>(ch);
+                if((byte & 0xC0) != 0x80)
+                    ++ length;
+                if(byte >= 0xF0) // a surrogate pair
+                    ++ length;
+            }
+            return length;
+        }
+
+        size_t wideStringBytes(size_t length)
+        {
+            const size_t SsoCapacity = 16 / sizeof(wchar_t) - 1; // MSVC keeps this many in the object
+            return sizeof(std::wstring) + (length > SsoCapacity ? (length + 1) * sizeof(wchar_t) : 0);
+        }
+
+        size_t decimalLength(uint64_t value)
+        {
+            size_t length = 1;
+            while(value >= 10)
+            {
+                value /= 10;
+                ++ length;
+            }
+            return length;
+        }
+    }
+
+    UserTable::UserTable()
+        : purgeAt_(1024)
+    {
+    }
+
+    UserTable::~UserTable()
+    {
+    }
+
+    std::shared_ptr<const UserRecord> UserTable::intern(uint64_t id, boost::string_view screenName, boost::string_view name)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        auto &entry = users_[id];
+        auto user = entry.lock();
+        if(user && user->screenName_ == screenName && user->name_ == name)
+            return user;
+
+        auto record = std::make_shared<UserRecord>();
+        record->id_ = id;
+        record->screenName_.assign(screenName.data(), screenName.size());
+        record->name_.assign(name.data(), name.size());
+        entry = record;
+
+        if(users_.size() >= purgeAt_)
+        {
+            for(auto it = users_.begin(); it != users_.end();)
+            {
+                if(it->second.expired())
+                    it = users_.erase(it);
+                else
+                    ++ it;
+            }
+            purgeAt_ = std::max<size_t>(1024, users_.size() * 2);
+        }
+
+        return record;
+    }
+
+    size_t UserTable::size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return users_.size();
+    }
+
+    boost::string_view EntityRange::extra() const
+    {
+        return boost::string_view(extra_, extraSize_);
+    }
+
+    boost::string_view TweetRecord::text() const
+    {
+        return boost::string_view(text_, textSize_);
+    }
+
+    TweetBatch::TweetBatch()
+        : blockUsed_(0)
+        , arenaUsed_(0)
+        , arenaHeld_(0)
+    {
+    }
+
+    TweetBatch::~TweetBatch()
+    {
+        auto &pool = Batang::ChunkPool::instance();
+        for(auto &block: blocks_)
+            pool.release(std::move(block));
+    }
+
+    bool TweetBatch::addStatus(const JsonValue &status)
+    {
+        JsonValue value, user, text, extended, entities;
+
+        TweetRecord tweet = {};
+        if(!status.find("id", value) || !value.getUint64(tweet.id_))
+            return false;
+        if(!status.find("created_at", value) || !readString(value, scratch_) || !parseCreatedAt(scratch_, tweet.createdAt_))
+            return false;
+
+        // the whole text of a status over 140 characters is apart, with its own entities
+        if(status.find("extended_tweet", extended) && extended.find("full_text", text))
+            extended.find("entities", entities);
+        else if(status.find("full_text", text) || status.find("text", text))
+            status.find("entities", entities);
+        else
+            return false;
+        if(!readString(text, scratch_))
+            return false;
+
+        // nothing goes into the arena until the status is known to be whole
+        uint64_t userId;
+        std::string screenName, name;
+        if(!status.find("user", user) || !user.find("id", value) || !value.getUint64(userId)
+            || !user.find("screen_name", value) || !readString(value, screenName)
+            || !user.find("name", value) || !readString(value, name))
+            return false;
+
+        tweet.text_ = store(scratch_);
+        tweet.textSize_ = static_cast<uint32_t>(scratch_.size());
+        users_.push_back(UserTable::instance().intern(userId, screenName, name));
+        tweet.user_ = users_.back().get();
+
+        bool flag;
+        if(status.find("retweeted_status", value) && value.type() == JsonValue::Object)
+            tweet.flags_ |= TweetRecord::Retweet;
+        if(status.find("in_reply_to_status_id", value) && value.type() == JsonValue::Number)
+            tweet.flags_ |= TweetRecord::Reply;
+        if(status.find("is_quote_status", value) && value.getBool(flag) && flag)
+            tweet.flags_ |= TweetRecord::Quote;
+        if(status.find("possibly_sensitive", value) && value.getBool(flag) && flag)
+            tweet.flags_ |= TweetRecord::Sensitive;
+
+        tweet.entityBegin_ = static_cast<uint32_t>(entities_.size());
+        if(entities.type() == JsonValue::Object)
+            addEntities(entities);
+        tweet.entityCount_ = static_cast<uint32_t>(entities_.size()) - tweet.entityBegin_;
+
+        tweets_.push_back(tweet);
+        return true;
+    }
+
+    void TweetBatch::add(const TweetRecord &record, std::shared_ptr<const UserRecord> user, const EntityRange *entities)
+    {
+        TweetRecord tweet = record;
+        tweet.text_ = store(record.text());
+        tweet.entityBegin_ = static_cast<uint32_t>(entities_.size());
+
+        for(uint32_t i = 0; i < record.entityCount_; ++ i)
+        {
+            EntityRange range = entities[i];
+            range.extra_ = store(entities[i].extra());
+            entities_.push_back(range);
+        }
+
+        users_.push_back(std::move(user));
+        tweet.user_ = users_.back().get();
+        tweets_.push_back(tweet);
+    }
+
+    void TweetBatch::compact()
+    {
+        tweets_.shrink_to_fit();
+        entities_.shrink_to_fit();
+        users_.shrink_to_fit();
+        if(blocks_.empty())
+            return;
+
+        // strings up to a chunk long are in the blocks or packed_, longer ones in large_ stay put
+        size_t size = 0, largeSize = 0;
+        for(auto &tweet: tweets_)
+            (tweet.textSize_ <= Batang::ChunkPool::ChunkSize ? size : largeSize) += tweet.textSize_;
+        for(auto &entity: entities_)
+            (entity.extraSize_ <= Batang::ChunkPool::ChunkSize ? size : largeSize) += entity.extraSize_;
+
+        std::unique_ptr<char[]> packed(new char[size]);
+        char *p = packed.get();
+        auto move = [&p](const char *&str, uint32_t strSize)
+        {
+            if(str && strSize <= Batang::ChunkPool::ChunkSize)
+            {
+                std::memcpy(p, str, strSize);
+                str = p;
+                p += strSize;
+            }
+        };
+        for(auto &tweet: tweets_)
+            move(tweet.text_, tweet.textSize_);
+        for(auto &entity: entities_)
+            move(entity.extra_, entity.extraSize_);
+
+        auto &pool = Batang::ChunkPool::instance();
+        for(auto &block: blocks_)
+            pool.release(std::move(block));
+        blocks_.clear();
+        blockUsed_ = 0;
+
+        arenaUsed_ = arenaHeld_ = size + largeSize;
+        packed_ = std::move(packed);
+    }
+
+    size_t TweetBatch::size() const
+    {
+        return tweets_.size();
+    }
+
+    bool TweetBatch::empty() const
+    {
+        return tweets_.empty();
+    }
+
+    const std::vector<TweetRecord> &TweetBatch::tweets() const
+    {
+        return tweets_;
+    }
+
+    const EntityRange *TweetBatch::entities(const TweetRecord &tweet) const
+    {
+        if(tweet.entityCount_ == 0)
+            return nullptr;
+        return &entities_[tweet.entityBegin_];
+    }
+
+    const std::shared_ptr<const UserRecord> &TweetBatch::user(const TweetRecord &tweet) const
+    {
+        return users_[&tweet - tweets_.data()];
+    }
+
+    TweetBatch::MemoryReport TweetBatch::memoryReport() const
+    {
+        MemoryReport report = {};
+        report.tweets_ = tweets_.size();
+        report.compactBytes_ = sizeof(TweetBatch)
+            + tweets_.capacity() * sizeof(TweetRecord)
+            + entities_.capacity() * sizeof(EntityRange)
+            + users_.capacity() * sizeof(std::shared_ptr<const UserRecord>)
+            + arenaHeld_;
+        report.arenaSlack_ = arenaHeld_ - arenaUsed_;
+
+        for(auto &tweet: tweets_)
+        {
+            report.wideBytes_ += wideStringBytes(decimalLength(tweet.user_->id_))
+                + wideStringBytes(utf16Length(tweet.user_->screenName_))
+                + wideStringBytes(utf16Length(tweet.text()));
+        }
+        return report;
+    }
+
+    bool TweetBatch::readString(const JsonValue &value, std::string &out)
+    {
+        out.clear();
+        return value.getString(out);
+    }
+
+    const char *TweetBatch::store(boost::string_view str)
+    {
+        if(str.empty())
+            return nullptr;
+
+        arenaUsed_ += str.size();
+        if(str.size() > Batang::ChunkPool::ChunkSize)
+        {
+            arenaHeld_ += str.size();
+            large_.emplace_back(new char[str.size()]);
+            std::memcpy(large_.back().get(), str.data(), str.size());
+            return large_.back().get();
+        }
+
+        if(blocks_.empty() || Batang::ChunkPool::ChunkSize - blockUsed_ < str.size())
+        {
+            blocks_.push_back(Batang::ChunkPool::instance().acquire());
+            blockUsed_ = 0;
+            arenaHeld_ += Batang::ChunkPool::ChunkSize;
+        }
+
+        char *p = reinterpret_cast<char *>(blocks_.back().get()) + blockUsed_;
+        std::memcpy(p, str.data(), str.size());
+        blockUsed_ += str.size();
+        return p;
+    }
+
+    void TweetBatch::addEntities(const JsonValue &entities)
+    {
+        static const struct
+        {
+            const char *name_;
+            EntityRange::Kind kind_;
+            const char *extra_;
+        } kinds[] =
+        {
+            { "hashtags", EntityRange::Hashtag, nullptr },
+            { "urls", EntityRange::Url, "expanded_url" },
+            { "user_mentions", EntityRange::Mention, nullptr },
+            { "media", EntityRange::Media, "media_url_https" },
+        };
+
+        size_t begin = entities_.size();
+        for(auto &kind: kinds)
+        {
+            JsonValue list;
+            if(!entities.find(kind.name_, list))
+                continue;
+
+            list.forEach([this, &kind](const JsonValue &entity)
+            {
+                JsonValue indices, extra;
+                uint64_t bounds[2];
+                size_t count = 0;
+                if(!entity.find("indices", indices))
+                    return;
+                indices.forEach([&bounds, &count](const JsonValue &index)
+                {
+                    if(count < 2 && index.getUint64(bounds[count]))
+                        ++ count;
+                });
+                if(count != 2 || bounds[0] > bounds[1] || bounds[1] > std::numeric_limits<uint32_t>::max())
+                    return;
+
+                EntityRange range = {};
+                range.begin_ = static_cast<uint32_t>(bounds[0]);
+                range.end_ = static_cast<uint32_t>(bounds[1]);
+                range.kind_ = kind.kind_;
+                if(kind.extra_ && entity.find(kind.extra_, extra) && readString(extra, scratch_))
+                {
+                    range.extra_ = store(scratch_);
+                    range.extraSize_ = static_cast<uint32_t>(scratch_.size());
+                }
+                entities_.push_back(range);
+            });
+        }
+
+        // in the order they appear in the text
+        std::sort(entities_.begin() + begin, entities_.end(), [](const EntityRange &lhs, const EntityRange &rhs)
+        {
+            return lhs.begin_ < rhs.begin_;
+        });
+    }
+}
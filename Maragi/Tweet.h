@@ -0,0 +1,131 @@
+﻿#pragma once
+
+#include "../Batang/Singleton.h"
+
+namespace Maragi
+{
+    class JsonValue;
+
+    struct UserRecord
+    {
+        uint64_t id_;
+        std::string screenName_; // UTF-8
+        std::string name_;
+    };
+
+    // Interns user records by id, so all tweets of a user share one record while any of them is alive.
+    class UserTable final : public Batang::Singleton<UserTable, Batang::DestructPriority::Normal, Batang::ExitBehavior::Skip>
+    {
+    private:
+        mutable std::mutex mutex_;
+        std::unordered_map<uint64_t, std::weak_ptr<const UserRecord>> users_;
+        size_t purgeAt_; // expired entries are swept when the table grows to this
+
+    private:
+        UserTable();
+        ~UserTable();
+
+    public:
+        // A changed screen name or name makes a new record; tweets already parsed keep the old one.
+        std::shared_ptr<const UserRecord> intern(uint64_t id, boost::string_view screenName, boost::string_view name);
+        size_t size() const;
+
+        friend class Batang::Singleton<UserTable, Batang::DestructPriority::Normal, Batang::ExitBehavior::Skip>;
+    };
+
+    struct EntityRange
+    {
+        enum Kind
+        {
+            Hashtag,
+            Url,
+            Mention,
+            Media,
+        };
+
+        uint32_t begin_; // code point offsets into the text, as the API gives them
+        uint32_t end_;
+        uint32_t kind_;
+        uint32_t extraSize_;
+        const char *extra_; // expanded URL of Url and Media, in the batch arena; empty otherwise
+
+        boost::string_view extra() const;
+    };
+
+    struct TweetRecord
+    {
+        enum Flags
+        {
+            Retweet = 1 << 0,
+            Reply = 1 << 1,
+            Quote = 1 << 2,
+            Sensitive = 1 << 3,
+        };
+
+        uint64_t id_;
+        int64_t createdAt_; // seconds since the epoch, UTC
+        const UserRecord *user_; // kept alive by the batch
+        const char *text_; // UTF-8 in the batch arena, not terminated
+        uint32_t textSize_;
+        uint32_t flags_;
+        uint32_t entityBegin_; // into TweetBatch::entities()
+        uint32_t entityCount_;
+
+        boost::string_view text() const;
+    };
+
+    // Tweets parsed together. Texts and entity strings are packed into an arena of pooled chunks and
+    // records point into it, so a tweet costs one fixed-size record plus its UTF-8 bytes.
+    // A batch is compacted and then not modified once handed out; share it with std::shared_ptr<const TweetBatch>.
+    class TweetBatch final
+    {
+    public:
+        struct MemoryReport
+        {
+            size_t tweets_;
+            size_t compactBytes_; // records, entities and arena bytes held; interned users are not counted
+            size_t arenaSlack_; // arena bytes held but unused, none once compacted
+            size_t wideBytes_; // the same tweets as three std::wstring each (author id, author name, text)
+        };
+
+    private:
+        std::vector<std::unique_ptr<uint8_t[]>> blocks_; // Batang::ChunkPool chunks
+        size_t blockUsed_; // in the last block
+        size_t arenaUsed_; // in all blocks, large_ and packed_
+        size_t arenaHeld_;
+        std::vector<std::unique_ptr<char[]>> large_; // strings which do not fit a chunk
+        std::unique_ptr<char[]> packed_; // what compact() moved out of the blocks
+        std::vector<TweetRecord> tweets_;
+        std::vector<EntityRange> entities_;
+        std::vector<std::shared_ptr<const UserRecord>> users_;
+        std::string scratch_;
+
+    public:
+        TweetBatch();
+        ~TweetBatch();
+
+    private:
+        TweetBatch(const TweetBatch &) = delete;
+        TweetBatch &operator =(const TweetBatch &) = delete;
+
+    public:
+        bool addStatus(const JsonValue &status); // false, adding nothing, for anything else than a status
+        // Copies the text and entity strings into the arena; for records from elsewhere than the API.
+        void add(const TweetRecord &, std::shared_ptr<const UserRecord> user, const EntityRange *entities);
+        // Moves the strings in the chunks into one block of their size and gives the chunks back to the pool,
+        // so a batch of a few tweets does not hold a whole chunk while it is alive.
+        void compact();
+
+        size_t size() const;
+        bool empty() const;
+        const std::vector<TweetRecord> &tweets() const;
+        const EntityRange *entities(const TweetRecord &) const; // entityCount_ of them
+        const std::shared_ptr<const UserRecord> &user(const TweetRecord &) const; // what keeps user_ alive
+        MemoryReport memoryReport() const;
+
+    private:
+        bool readString(const JsonValue &, std::string &);
+        const char *store(boost::string_view);
+        void addEntities(const JsonValue &entities);
+    };
+}
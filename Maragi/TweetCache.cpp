@@ -0,0 +1,732 @@
+﻿#include "Common.h"
+
+#include "TweetCache.h"
+#include "Utility.h"
+
+namespace Maragi
+{
+    const size_t TweetCache::SegmentSize = 4 * 1024 * 1024;
+    const size_t TweetCache::CompactAfter = 4;
+    const size_t TweetCache::IndexStride = 64;
+    const size_t TweetCache::DefaultRetain = 20000;
+
+    namespace
+    {
+        const uint32_t SegmentMagic = 0x3143544D; // "MTC1"
+
+        enum SegmentFlags
+        {
+            Sorted = 1 << 0,
+            Compressed = 1 << 1,
+        };
+
+        // Followed by the payload: entries one after another. A merged segment stores storedSize_ bytes of
+        // payload, padded to 8 bytes, then indexCount_ index points, then if compressed indexCount_ block points;
+        // an appended one runs to the end of the file.
+        struct SegmentHeader
+        {
+            uint32_t magic_;
+            uint32_t flags_;
+            uint64_t payloadSize_; // of a merged segment, inflated
+            uint64_t storedSize_;
+            uint32_t indexCount_;
+            uint32_t reserved_;
+        };
+        static_assert(sizeof(SegmentHeader) == 32, "SegmentHeader is a file format");
+
+        // Followed by the screen name, name and text in UTF-8, then entityCount_ EntityHeaders each followed by its extra.
+        struct EntryHeader
+        {
+            uint32_t size_; // the whole entry
+            uint32_t textSize_;
+            uint64_t id_;
+            int64_t createdAt_;
+            uint64_t userId_;
+            uint32_t flags_;
+            uint16_t screenNameSize_;
+            uint16_t nameSize_;
+            uint32_t entityCount_;
+            uint32_t reserved_;
+        };
+        static_assert(sizeof(EntryHeader) == 48, "EntryHeader is a file format");
+
+        struct EntityHeader
+        {
+            uint32_t begin_;
+            uint32_t end_;
+            uint32_t kind_;
+            uint32_t extraSize_;
+        };
+
+        struct IndexPoint
+        {
+            uint64_t id_;
+            uint64_t offset_; // into the payload
+        };
+
+        // The entries from one index point to the next, deflated on their own so a load inflates only what it reads.
+        struct BlockPoint
+        {
+            uint64_t storedOffset_; // into the stored bytes
+            uint32_t storedSize_;
+            uint32_t size_; // inflated
+        };
+        static_assert(sizeof(BlockPoint) == 16, "BlockPoint is a file format");
+
+        struct Candidate
+        {
+            uint64_t id_;
+            size_t segment_; // the newer segment wins a duplicate
+            const uint8_t *entry_;
+            size_t size_;
+        };
+
+        struct FileCloser
+        {
+            void operator ()(HANDLE file) const
+            {
+                if(file != INVALID_HANDLE_VALUE)
+                    CloseHandle(file);
+            }
+        };
+
+        typedef std::unique_ptr<void, FileCloser> FileHandle;
+
+        inline uint64_t alignUp(uint64_t size)
+        {
+            return (size + 7) & ~static_cast<uint64_t>(7);
+        }
+
+        bool writeAll(HANDLE file, const void *data, size_t size)
+        {
+            ulong32_t written = 0;
+            return WriteFile(file, data, static_cast<ulong32_t>(size), &written, nullptr) && written == size;
+        }
+
+        void appendBytes(std::vector<uint8_t> &out, const void *data, size_t size)
+        {
+            const uint8_t *bytes = static_cast<const uint8_t *>(data);
+            out.insert(out.end(), bytes, bytes + size);
+        }
+
+        // Size of the entry at data, or 0 if it is cut short or its parts do not add up to it.
+        size_t entrySize(const uint8_t *data, size_t remain)
+        {
+            if(remain < sizeof(EntryHeader))
+                return 0;
+
+            EntryHeader header;
+            std::memcpy(&header, data, sizeof(header));
+            if(header.size_ < sizeof(EntryHeader) || header.size_ > remain)
+                return 0;
+
+            uint64_t used = sizeof(EntryHeader) + static_cast<uint64_t>(header.screenNameSize_) + header.nameSize_ + header.textSize_;
+            for(uint32_t i = 0; i < header.entityCount_; ++ i)
+            {
+                if(used + sizeof(EntityHeader) > header.size_)
+                    return 0;
+
+                EntityHeader entity;
+                std::memcpy(&entity, data + used, sizeof(entity));
+                used += sizeof(EntityHeader) + static_cast<uint64_t>(entity.extraSize_);
+            }
+            return used == header.size_ ? header.size_ : 0;
+        }
+
+        uint64_t entryId(const uint8_t *entry)
+        {
+            uint64_t id;
+            std::memcpy(&id, entry + offsetof(EntryHeader, id_), sizeof(id));
+            return id;
+        }
+
+        // Calls fn(entry, size) for each entry until it returns false or the payload ends or breaks off;
+        // returns the bytes walked over.
+        template<typename Function>
+        size_t forEachEntry(const uint8_t *data, size_t size, Function fn)
+        {
+            size_t offset = 0;
+            while(size_t entry = entrySize(data + offset, size - offset))
+            {
+                if(!fn(data + offset, entry))
+                    break;
+                offset += entry;
+            }
+            return offset;
+        }
+
+        void encodeEntry(const TweetRecord &tweet, const EntityRange *entities, std::vector<uint8_t> &out)
+        {
+            boost::string_view screenName, name;
+            if(tweet.user_)
+            {
+                screenName = tweet.user_->screenName_;
+                name = tweet.user_->name_;
+            }
+            screenName = screenName.substr(0, std::numeric_limits<uint16_t>::max());
+            name = name.substr(0, std::numeric_limits<uint16_t>::max());
+
+            EntryHeader header = {};
+            header.textSize_ = tweet.textSize_;
+            header.id_ = tweet.id_;
+            header.createdAt_ = tweet.createdAt_;
+            header.userId_ = tweet.user_ ? tweet.user_->id_ : 0;
+            header.flags_ = tweet.flags_;
+            header.screenNameSize_ = static_cast<uint16_t>(screenName.size());
+            header.nameSize_ = static_cast<uint16_t>(name.size());
+            header.entityCount_ = tweet.entityCount_;
+
+            size_t begin = out.size();
+            out.resize(begin + sizeof(header)); // filled in once the size is known
+            appendBytes(out, screenName.data(), screenName.size());
+            appendBytes(out, name.data(), name.size());
+            appendBytes(out, tweet.text_, tweet.textSize_);
+            for(uint32_t i = 0; i < tweet.entityCount_; ++ i)
+            {
+                EntityHeader entity = {entities[i].begin_, entities[i].end_, entities[i].kind_, entities[i].extraSize_};
+                appendBytes(out, &entity, sizeof(entity));
+                appendBytes(out, entities[i].extra_, entities[i].extraSize_);
+            }
+
+            header.size_ = static_cast<uint32_t>(out.size() - begin);
+            std::memcpy(&out[begin], &header, sizeof(header));
+        }
+
+        // The entry must have passed entrySize().
+        void decodeEntry(const uint8_t *entry, TweetBatch &batch, std::vector<EntityRange> &entities)
+        {
+            EntryHeader header;
+            std::memcpy(&header, entry, sizeof(header));
+
+            const char *p = reinterpret_cast<const char *>(entry + sizeof(header));
+            boost::string_view screenName(p, header.screenNameSize_);
+            p += header.screenNameSize_;
+            boost::string_view name(p, header.nameSize_);
+            p += header.nameSize_;
+
+            TweetRecord record = {};
+            record.id_ = header.id_;
+            record.createdAt_ = header.createdAt_;
+            record.text_ = p;
+            record.textSize_ = header.textSize_;
+            record.flags_ = header.flags_;
+            record.entityCount_ = header.entityCount_;
+            p += header.textSize_;
+
+            entities.clear();
+            for(uint32_t i = 0; i < header.entityCount_; ++ i)
+            {
+                EntityHeader entity;
+                std::memcpy(&entity, p, sizeof(entity));
+                p += sizeof(entity);
+
+                EntityRange range = {entity.begin_, entity.end_, entity.kind_, entity.extraSize_, p};
+                entities.push_back(range);
+                p += entity.extraSize_;
+            }
+
+            batch.add(record, UserTable::instance().intern(header.userId_, screenName, name), entities.data());
+        }
+
+        // Maps a segment file for reading; the blocks of a compressed one are inflated into memory as they are reached.
+        class SegmentReader
+        {
+        private:
+            FileHandle file_;
+            HANDLE mapping_;
+            const uint8_t *view_;
+            bool valid_;
+            const uint8_t *payload_; // null if compressed
+            size_t payloadSize_;
+            uint64_t storedSize_;
+            bool sorted_;
+            const IndexPoint *index_;
+            size_t indexCount_;
+            const BlockPoint *blocks_; // null unless compressed
+            std::vector<std::vector<uint8_t>> inflated_;
+
+        public:
+            explicit SegmentReader(const std::wstring &path)
+                : file_(CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr))
+                , mapping_(nullptr)
+                , view_(nullptr)
+                , valid_(false)
+                , payload_(nullptr)
+                , payloadSize_(0)
+                , storedSize_(0)
+                , sorted_(false)
+                , index_(nullptr)
+                , indexCount_(0)
+                , blocks_(nullptr)
+            {
+                if(file_.get() == INVALID_HANDLE_VALUE)
+                    return;
+
+                LARGE_INTEGER size;
+                if(!GetFileSizeEx(file_.get(), &size) || static_cast<uint64_t>(size.QuadPart) < sizeof(SegmentHeader))
+                    return;
+                uint64_t fileSize = static_cast<uint64_t>(size.QuadPart);
+
+                mapping_ = CreateFileMappingW(file_.get(), nullptr, PAGE_READONLY, 0, 0, nullptr);
+                if(!mapping_)
+                    return;
+                view_ = static_cast<const uint8_t *>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+                if(!view_)
+                    return;
+
+                SegmentHeader header;
+                std::memcpy(&header, view_, sizeof(header));
+                if(header.magic_ != SegmentMagic)
+                    return;
+
+                if(!(header.flags_ & Sorted))
+                {
+                    payload_ = view_ + sizeof(SegmentHeader);
+                    payloadSize_ = static_cast<size_t>(fileSize - sizeof(SegmentHeader));
+                    valid_ = true;
+                    return;
+                }
+
+                uint64_t indexOffset = sizeof(SegmentHeader) + alignUp(header.storedSize_);
+                uint64_t blocksOffset = indexOffset + header.indexCount_ * sizeof(IndexPoint);
+                if(header.storedSize_ > fileSize || blocksOffset > fileSize)
+                    return;
+
+                if(header.flags_ & Compressed)
+                {
+#ifdef MARAGI_USE_ZLIB
+                    if(blocksOffset + header.indexCount_ * sizeof(BlockPoint) > fileSize)
+                        return;
+                    blocks_ = reinterpret_cast<const BlockPoint *>(view_ + blocksOffset);
+                    inflated_.resize(header.indexCount_);
+#else
+                    return; // written by a build with zlib
+#endif
+                }
+                else
+                {
+                    if(header.payloadSize_ != header.storedSize_)
+                        return;
+                    payload_ = view_ + sizeof(SegmentHeader);
+                }
+
+                payloadSize_ = static_cast<size_t>(header.payloadSize_);
+                storedSize_ = header.storedSize_;
+                sorted_ = true;
+                index_ = reinterpret_cast<const IndexPoint *>(view_ + indexOffset);
+                indexCount_ = header.indexCount_;
+                valid_ = true;
+            }
+
+            ~SegmentReader()
+            {
+                if(view_)
+                    UnmapViewOfFile(view_);
+                if(mapping_)
+                    CloseHandle(mapping_);
+            }
+
+        private:
+            SegmentReader(const SegmentReader &) = delete;
+            SegmentReader &operator =(const SegmentReader &) = delete;
+
+        public:
+            bool valid() const
+            {
+                return valid_;
+            }
+
+            // Of an appended segment only.
+            const uint8_t *payload() const
+            {
+                return payload_;
+            }
+
+            size_t payloadSize() const
+            {
+                return payloadSize_;
+            }
+
+            bool sorted() const
+            {
+                return sorted_;
+            }
+
+            const IndexPoint *index() const
+            {
+                return index_;
+            }
+
+            size_t indexCount() const
+            {
+                return indexCount_;
+            }
+
+            // Calls fn(entry, size) for each entry from index point first on, or all of an appended segment, until it
+            // returns false. The entries stay in place as long as the reader.
+            template<typename Function>
+            void forEachEntryFrom(size_t first, Function fn)
+            {
+                if(!blocks_)
+                {
+                    size_t offset = first < indexCount_ ? static_cast<size_t>(index_[first].offset_) : 0;
+                    if(offset <= payloadSize_)
+                        forEachEntry(payload_ + offset, payloadSize_ - offset, fn);
+                    return;
+                }
+
+                bool more = true;
+                for(size_t i = first; more && i < indexCount_; ++ i)
+                {
+                    const std::vector<uint8_t> &block = inflate(i);
+                    forEachEntry(block.data(), block.size(), [&](const uint8_t *entry, size_t size)
+                    {
+                        return more = fn(entry, size);
+                    });
+                }
+            }
+
+        private:
+            // Empty if the block is broken.
+            const std::vector<uint8_t> &inflate(size_t i)
+            {
+                std::vector<uint8_t> &block = inflated_[i];
+#ifdef MARAGI_USE_ZLIB
+                BlockPoint point;
+                std::memcpy(&point, blocks_ + i, sizeof(point));
+                if(block.empty() && point.storedOffset_ + point.storedSize_ <= storedSize_ && point.size_ <= payloadSize_)
+                {
+                    block.resize(point.size_);
+                    uLongf inflatedSize = static_cast<uLongf>(block.size());
+                    if(uncompress(block.data(), &inflatedSize, view_ + sizeof(SegmentHeader) + point.storedOffset_, point.storedSize_) != Z_OK
+                        || inflatedSize != block.size())
+                        block.clear();
+                }
+#endif
+                return block;
+            }
+        };
+    }
+
+    double TweetCache::Stats::writeAmplification() const
+    {
+        return appended_ == 0 ? 0.0 : static_cast<double>(written_) / static_cast<double>(appended_);
+    }
+
+    TweetCache::TweetCache(const std::wstring &name, size_t retain)
+        : directory_(getDataDirectoryPath() + L"Cache\\" + name + L"\\")
+        , retain_(retain)
+        , file_(INVALID_HANDLE_VALUE)
+        , stats_()
+    {
+        boost::filesystem::create_directories(directory_);
+
+        for(auto &entry: boost::filesystem::directory_iterator(directory_))
+        {
+            const auto &path = entry.path();
+            if(path.extension() == L".tmp") // a merge cut short
+            {
+                boost::system::error_code ec;
+                boost::filesystem::remove(path, ec);
+                continue;
+            }
+
+            std::wstring stem = path.stem().wstring();
+            if(path.extension() != L".seg" || stem.size() != 8 || !std::all_of(stem.begin(), stem.end(), [](wchar_t ch) { return ch >= L'0' && ch <= L'9'; }))
+                continue;
+
+            FileHandle file(CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+            if(file.get() == INVALID_HANDLE_VALUE)
+                continue;
+
+            SegmentHeader header;
+            ulong32_t read = 0;
+            LARGE_INTEGER size;
+            if(!ReadFile(file.get(), &header, sizeof(header), &read, nullptr) || read != sizeof(header) || header.magic_ != SegmentMagic
+                || !GetFileSizeEx(file.get(), &size))
+                continue;
+
+            Segment segment = {static_cast<uint32_t>(std::wcstoul(stem.c_str(), nullptr, 10)), (header.flags_ & Sorted) != 0, static_cast<uint64_t>(size.QuadPart)};
+            segments_.push_back(segment);
+        }
+
+        std::sort(segments_.begin(), segments_.end(), [](const Segment &lhs, const Segment &rhs) { return lhs.number_ < rhs.number_; });
+
+        if(!segments_.empty() && !segments_.back().sorted_ && segments_.back().size_ < SegmentSize)
+            resumeSegment();
+    }
+
+    TweetCache::~TweetCache()
+    {
+        closeSegment();
+    }
+
+    void TweetCache::append(const TweetBatch &batch)
+    {
+        if(batch.empty())
+            return;
+
+        buffer_.clear();
+        for(auto &tweet: batch.tweets())
+            encodeEntry(tweet, batch.entities(tweet), buffer_);
+
+        if(file_ == INVALID_HANDLE_VALUE)
+            openSegment();
+
+        if(!writeAll(file_, buffer_.data(), buffer_.size()))
+        {
+            closeSegment(); // readers stop where the write broke off; the next batch starts a new segment
+            throw(std::runtime_error("cannot write to the tweet cache"));
+        }
+
+        segments_.back().size_ += buffer_.size();
+        stats_.appended_ += buffer_.size();
+        stats_.written_ += buffer_.size();
+
+        if(segments_.back().size_ >= SegmentSize)
+        {
+            closeSegment();
+            if(sealedUnsorted() >= CompactAfter)
+                compact();
+        }
+    }
+
+    void TweetCache::compact()
+    {
+        size_t sealed = segments_.size() - (file_ != INVALID_HANDLE_VALUE ? 1 : 0);
+        if(sealed == 0 || (sealed == 1 && segments_.front().sorted_))
+            return;
+
+        std::vector<uint8_t> payload;
+        std::vector<IndexPoint> index;
+        {
+            std::vector<std::unique_ptr<SegmentReader>> readers;
+            std::vector<Candidate> entries;
+            for(size_t i = 0; i < sealed; ++ i)
+            {
+                readers.push_back(std::make_unique<SegmentReader>(segmentPath(segments_[i].number_)));
+                if(!readers.back()->valid())
+                    continue;
+
+                readers.back()->forEachEntryFrom(0, [&](const uint8_t *entry, size_t size)
+                {
+                    Candidate candidate = {entryId(entry), i, entry, size};
+                    entries.push_back(candidate);
+                    return true;
+                });
+            }
+
+            std::sort(entries.begin(), entries.end(), [](const Candidate &lhs, const Candidate &rhs)
+            {
+                return lhs.id_ < rhs.id_ || (lhs.id_ == rhs.id_ && lhs.segment_ > rhs.segment_);
+            });
+            entries.erase(std::unique(entries.begin(), entries.end(), [](const Candidate &lhs, const Candidate &rhs) { return lhs.id_ == rhs.id_; }), entries.end());
+            if(entries.size() > retain_)
+                entries.erase(entries.begin(), entries.end() - retain_);
+
+            for(size_t i = 0; i < entries.size(); ++ i)
+            {
+                if(i % IndexStride == 0)
+                {
+                    IndexPoint point = {entries[i].id_, payload.size()};
+                    index.push_back(point);
+                }
+                appendBytes(payload, entries[i].entry_, entries[i].size_);
+            }
+        } // unmapped before the files are replaced
+
+        SegmentHeader header = {SegmentMagic, Sorted, payload.size(), payload.size(), static_cast<uint32_t>(index.size()), 0};
+        const std::vector<uint8_t> *stored = &payload;
+        std::vector<BlockPoint> blocks;
+#ifdef MARAGI_USE_ZLIB
+        std::vector<uint8_t> compressed;
+        bool deflated = true;
+        for(size_t i = 0; deflated && i < index.size(); ++ i)
+        {
+            size_t begin = static_cast<size_t>(index[i].offset_);
+            size_t end = i + 1 < index.size() ? static_cast<size_t>(index[i + 1].offset_) : payload.size();
+
+            BlockPoint block = {compressed.size(), 0, static_cast<uint32_t>(end - begin)};
+            compressed.resize(compressed.size() + compressBound(static_cast<uLong>(end - begin)));
+            uLongf compressedSize = static_cast<uLongf>(compressed.size() - block.storedOffset_);
+            deflated = compress2(&compressed[static_cast<size_t>(block.storedOffset_)], &compressedSize, payload.data() + begin, static_cast<uLong>(end - begin), Z_BEST_SPEED) == Z_OK;
+            compressed.resize(static_cast<size_t>(block.storedOffset_) + compressedSize);
+            block.storedSize_ = static_cast<uint32_t>(compressedSize);
+            blocks.push_back(block);
+        }
+
+        if(deflated && !compressed.empty() && compressed.size() + blocks.size() * sizeof(BlockPoint) < payload.size())
+        {
+            header.flags_ |= Compressed;
+            header.storedSize_ = compressed.size();
+            stored = &compressed;
+        }
+        else
+            blocks.clear();
+#endif
+
+        uint32_t number = segments_[sealed - 1].number_;
+        std::wstring tempPath = directory_ + std::to_wstring(number) + L".tmp";
+        {
+            FileHandle file(CreateFileW(tempPath.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr));
+            if(file.get() == INVALID_HANDLE_VALUE)
+                throw(std::runtime_error("cannot create a tweet cache segment"));
+
+            static const uint8_t padding[8] = {};
+            if(!writeAll(file.get(), &header, sizeof(header)) || !writeAll(file.get(), stored->data(), stored->size())
+                || !writeAll(file.get(), padding, static_cast<size_t>(alignUp(stored->size()) - stored->size()))
+                || !writeAll(file.get(), index.data(), index.size() * sizeof(IndexPoint))
+                || !writeAll(file.get(), blocks.data(), blocks.size() * sizeof(BlockPoint)))
+                throw(std::runtime_error("cannot write to the tweet cache"));
+        }
+
+        // the merged segment takes the newest number it replaces, keeping segments in age order
+        boost::filesystem::rename(tempPath, segmentPath(number));
+        for(size_t i = 0; i + 1 < sealed; ++ i)
+        {
+            boost::system::error_code ec;
+            boost::filesystem::remove(segmentPath(segments_[i].number_), ec);
+        }
+
+        uint64_t fileSize = sizeof(header) + alignUp(stored->size()) + index.size() * sizeof(IndexPoint) + blocks.size() * sizeof(BlockPoint);
+        segments_.erase(segments_.begin(), segments_.begin() + (sealed - 1));
+        segments_.front().sorted_ = true;
+        segments_.front().size_ = fileSize;
+
+        ++ stats_.compactions_;
+        stats_.written_ += fileSize;
+    }
+
+    std::shared_ptr<const TweetBatch> TweetCache::loadRecent(size_t count)
+    {
+        return loadBefore(std::numeric_limits<uint64_t>::max(), count);
+    }
+
+    std::shared_ptr<const TweetBatch> TweetCache::loadBefore(uint64_t beforeId, size_t count)
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto batch = std::make_shared<TweetBatch>();
+
+        std::vector<std::unique_ptr<SegmentReader>> readers;
+        std::vector<Candidate> candidates;
+        for(size_t i = 0; i < segments_.size(); ++ i)
+        {
+            readers.push_back(std::make_unique<SegmentReader>(segmentPath(segments_[i].number_)));
+            SegmentReader &reader = *readers.back();
+            if(!reader.valid())
+                continue;
+
+            size_t first = 0;
+            if(reader.sorted())
+            {
+                // the index point at or after beforeId, then back far enough to cover count entries
+                const IndexPoint *index = reader.index();
+                size_t after = std::lower_bound(index, index + reader.indexCount(), beforeId,
+                    [](const IndexPoint &point, uint64_t id) { return point.id_ < id; }) - index;
+                if(after == 0)
+                    continue;
+
+                size_t back = (count + IndexStride - 1) / IndexStride + 1;
+                first = after < back ? 0 : after - back;
+            }
+
+            bool sorted = reader.sorted();
+            reader.forEachEntryFrom(first, [&](const uint8_t *entry, size_t size)
+            {
+                uint64_t id = entryId(entry);
+                if(id >= beforeId)
+                    return !sorted;
+
+                Candidate candidate = {id, i, entry, size};
+                candidates.push_back(candidate);
+                return true;
+            });
+        }
+
+        std::sort(candidates.begin(), candidates.end(), [](const Candidate &lhs, const Candidate &rhs)
+        {
+            return lhs.id_ > rhs.id_ || (lhs.id_ == rhs.id_ && lhs.segment_ > rhs.segment_);
+        });
+        candidates.erase(std::unique(candidates.begin(), candidates.end(), [](const Candidate &lhs, const Candidate &rhs) { return lhs.id_ == rhs.id_; }), candidates.end());
+        if(candidates.size() > count)
+            candidates.resize(count);
+
+        std::vector<EntityRange> entities;
+        for(auto &candidate: candidates)
+            decodeEntry(candidate.entry_, *batch, entities);
+        batch->compact();
+
+        stats_.lastLoad_ = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        return batch;
+    }
+
+    const TweetCache::Stats &TweetCache::stats() const
+    {
+        return stats_;
+    }
+
+    std::wstring TweetCache::segmentPath(uint32_t number) const
+    {
+        std::array<wchar_t, 16> name;
+        swprintf(name.data(), name.size(), L"%08u.seg", number);
+        return directory_ + name.data();
+    }
+
+    void TweetCache::resumeSegment()
+    {
+        Segment &segment = segments_.back();
+
+        // drop whatever a crash left half written
+        uint64_t end;
+        {
+            SegmentReader reader(segmentPath(segment.number_));
+            if(!reader.valid())
+                return;
+            end = sizeof(SegmentHeader) + forEachEntry(reader.payload(), reader.payloadSize(), [](const uint8_t *, size_t) { return true; });
+        }
+
+        FileHandle file(CreateFileW(segmentPath(segment.number_).c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+        if(file.get() == INVALID_HANDLE_VALUE)
+            return;
+
+        LARGE_INTEGER position;
+        position.QuadPart = static_cast<LONGLONG>(end);
+        if(!SetFilePointerEx(file.get(), position, nullptr, FILE_BEGIN) || !SetEndOfFile(file.get()))
+            return;
+
+        segment.size_ = end;
+        file_ = file.release();
+    }
+
+    void TweetCache::openSegment()
+    {
+        uint32_t number = segments_.empty() ? 1 : segments_.back().number_ + 1;
+        FileHandle file(CreateFileW(segmentPath(number).c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr));
+        if(file.get() == INVALID_HANDLE_VALUE)
+            throw(std::runtime_error("cannot create a tweet cache segment"));
+
+        SegmentHeader header = {SegmentMagic, 0, 0, 0, 0, 0};
+        if(!writeAll(file.get(), &header, sizeof(header)))
+            throw(std::runtime_error("cannot write to the tweet cache"));
+
+        Segment segment = {number, false, sizeof(header)};
+        segments_.push_back(segment);
+        stats_.written_ += sizeof(header);
+        file_ = file.release();
+    }
+
+    void TweetCache::closeSegment()
+    {
+        if(file_ == INVALID_HANDLE_VALUE)
+            return;
+
+        CloseHandle(file_);
+        file_ = INVALID_HANDLE_VALUE;
+    }
+
+    size_t TweetCache::sealedUnsorted() const
+    {
+        size_t sealed = segments_.size() - (file_ != INVALID_HANDLE_VALUE ? 1 : 0);
+        return static_cast<size_t>(std::count_if(segments_.begin(), segments_.begin() + sealed, [](const Segment &segment) { return !segment.sorted_; }));
+    }
+}
@@ -0,0 +1,73 @@
+﻿#pragma once
+
+#include "Tweet.h"
+
+namespace Maragi
+{
+    // Tweets a timeline has shown, kept on disk so it has something to show before the network answers.
+    // Batches are appended to the newest segment file, which is sealed once it passes SegmentSize.
+    // Every CompactAfter sealed segments, the sealed segments are merged into one holding the newest
+    // tweets only, sorted by id and with a sparse id index. Segments are read through file mappings.
+    // Files live in getDataDirectoryPath()\Cache\<name>\; one cache per timeline, used from one thread.
+    // Building with MARAGI_USE_ZLIB compresses merged segments, an index stride at a time.
+    class TweetCache final
+    {
+    public:
+        struct Stats
+        {
+            uint64_t appended_; // entry bytes handed to append()
+            uint64_t written_; // bytes written to disk, headers and merges included
+            uint64_t compactions_;
+            std::chrono::microseconds lastLoad_; // the last loadRecent() or loadBefore(), from disk to batch
+
+            double writeAmplification() const;
+        };
+
+    private:
+        struct Segment
+        {
+            uint32_t number_; // file name; ascending with age
+            bool sorted_; // merged
+            uint64_t size_;
+        };
+
+    public:
+        static const size_t SegmentSize;
+        static const size_t CompactAfter;
+        static const size_t IndexStride; // entries per index point of a merged segment
+        static const size_t DefaultRetain;
+
+    private:
+        std::wstring directory_;
+        size_t retain_; // tweets a merge keeps
+        std::vector<Segment> segments_; // ascending by number
+        HANDLE file_; // the last segment, open for appending; INVALID_HANDLE_VALUE when sealed
+        std::vector<uint8_t> buffer_;
+        Stats stats_;
+
+    public:
+        explicit TweetCache(const std::wstring &name, size_t retain = DefaultRetain);
+        ~TweetCache();
+
+    private:
+        TweetCache(const TweetCache &) = delete;
+        TweetCache &operator =(const TweetCache &) = delete;
+
+    public:
+        void append(const TweetBatch &); // throws std::runtime_error if the segment cannot be written
+        void compact(); // merges the sealed segments now
+
+        // Newest first, each id once; the batch interns its users in UserTable.
+        std::shared_ptr<const TweetBatch> loadRecent(size_t count);
+        std::shared_ptr<const TweetBatch> loadBefore(uint64_t beforeId, size_t count);
+
+        const Stats &stats() const;
+
+    private:
+        std::wstring segmentPath(uint32_t number) const;
+        void resumeSegment();
+        void openSegment();
+        void closeSegment();
+        size_t sealedUnsorted() const;
+    };
+}
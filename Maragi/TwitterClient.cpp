@@ -7,6 +7,8 @@
 
 #include "Configure.h"
 #include "Constants.h"
+#include "CurlShare.h"
+#include "NetworkReactor.h"
 #include "Tokens.h"
 #include "TwitterClient.h"
 
@@ -50,14 +52,10 @@ namespace Maragi
     {
     }
 
-    TwitterClient::TwitterClient()
-        : TwitterClient({}, {}, {})
-    {}
-
-    TwitterClient::TwitterClient(const std::string &iscreenName, const std::string &iaccessToken, const std::string &iaccessTokenSecret)
-        : screenName_(iscreenName), accessToken_(iaccessToken), accessTokenSecret_(iaccessTokenSecret)
+    namespace
     {
-        struct CurlInitializer : Batang::Singleton<CurlInitializer>
+        // cleaned up after CurlShare and NetworkReactor, which hold curl handles of their own
+        struct CurlInitializer : Batang::Singleton<CurlInitializer, Batang::DestructPriority::Late, Batang::ExitBehavior::Skip>
         {
             CurlInitializer()
             {
@@ -69,7 +67,60 @@ namespace Maragi
             ~CurlInitializer() { curl_global_cleanup(); }
         };
 
-        CurlInitializer::instance();
+        // Peers are verified against the CA bundle named by the CaBundle configuration key,
+        // or against the Windows certificate store if none is given.
+        void setTlsVerification(CURL *curl)
+        {
+            curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1l);
+            curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 2l);
+
+            std::wstring bundle = Configure::instance().get(L"CaBundle");
+            if(!bundle.empty())
+                curl_easy_setopt(curl, CURLOPT_CAINFO, Batang::encodeUtf8(bundle).c_str());
+            else
+                curl_easy_setopt(curl, CURLOPT_SSL_OPTIONS, static_cast<long>(CURLSSLOPT_NATIVE_CA));
+        }
+    }
+
+    TwitterClient::TwitterClient()
+        : TwitterClient({}, {}, {})
+    {}
+
+    const size_t TwitterClient::MaxStreamBatch = 64;
+    const size_t TwitterClient::MaxStreamQueued = 1024 * 1024;
+    const size_t TwitterClient::DefaultTimelineCount = 20;
+    const size_t TwitterClient::HomeRestoreCount = 200;
+    const std::chrono::milliseconds TwitterClient::StreamBatchDelay(100);
+
+    TwitterClient::TwitterClient(const std::string &iscreenName, const std::string &iaccessToken, const std::string &iaccessTokenSecret)
+        : screenName_(iscreenName), accessToken_(iaccessToken), accessTokenSecret_(iaccessTokenSecret)
+        , signer_(AppTokens::CONSUMER_KEY, AppTokens::CONSUMER_SECRET, iaccessTokenSecret)
+        , responseCache_(Batang::decodeUtf8(iscreenName))
+        , streamCurl_(nullptr)
+        , streamHeader_(nullptr)
+        , streamQueued_(0)
+        , streamPaused_(false)
+        , streamBatch_(std::make_shared<TweetBatch>())
+        , streamBackoff_()
+        , streamStats_()
+        , requestStats_()
+    {
+        // a local stand-in server replaying recorded stream data can be put here for testing
+        streamUrl_ = Batang::encodeUtf8(Configure::instance().get(L"StreamUrl", Batang::decodeUtf8(Paths::USER_STREAM)));
+
+        if(!screenName_.empty())
+        {
+            try
+            {
+                homeCache_.reset(new TweetCache(Batang::decodeUtf8(screenName_) + L"\\Home"));
+            }
+            catch(const std::runtime_error &)
+            {
+                // the timeline comes from the network alone
+            }
+        }
+
+        initializeCurl();
 
         curl_ = curl_easy_init();
         if(curl_ == nullptr)
@@ -77,13 +128,18 @@ namespace Maragi
 
         cbd_.client = this;
 
+        CurlShare::instance().attach(curl_);
+
         curl_easy_setopt(curl_, CURLOPT_NOPROGRESS, 1l);
         curl_easy_setopt(curl_, CURLOPT_USERAGENT, Batang::encodeUtf8(Constants::USER_AGENT).c_str());
         curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION, &curlWriteCallback);
         curl_easy_setopt(curl_, CURLOPT_WRITEDATA, static_cast<void *>(&cbd_));
+        curl_easy_setopt(curl_, CURLOPT_HEADERFUNCTION, &curlHeaderCallback);
+        curl_easy_setopt(curl_, CURLOPT_HEADERDATA, static_cast<void *>(this));
+        curl_easy_setopt(curl_, CURLOPT_ACCEPT_ENCODING, ContentDecoder::AcceptEncoding);
+        curl_easy_setopt(curl_, CURLOPT_HTTP_CONTENT_DECODING, 0l); // decoded by cbd_.decoder, which keeps count
 
-        curl_easy_setopt(curl_, CURLOPT_SSL_VERIFYPEER, 0l);
-        curl_easy_setopt(curl_, CURLOPT_SSL_VERIFYHOST, 0l);
+        setTlsVerification(curl_);
     }
 
     TwitterClient::~TwitterClient()
@@ -91,12 +147,76 @@ namespace Maragi
         curl_easy_cleanup(curl_);
     }
 
+    void TwitterClient::initializeCurl()
+    {
+        CurlInitializer::instance();
+    }
+
+    std::string TwitterClient::name() const
+    {
+        return "TwitterClient(" + screenName_ + ")";
+    }
+
+    size_t TwitterClient::streamWriteCallback(void *data, size_t size, size_t nmemb, void *param)
+    {
+        // called on the reactor thread; the data is handed over to the client thread
+        TwitterClient *client = static_cast<TwitterClient *>(param);
+        size_t realSize = size * nmemb;
+
+        long status = 0;
+        curl_easy_getinfo(client->streamCurl_, CURLINFO_RESPONSE_CODE, &status);
+        if(status != 200) // an error page; the status decides the backoff once the transfer ends
+            return realSize;
+
+        // a client thread falling behind holds the socket back instead of queueing without bound;
+        // the flag goes up before the second look, so receiveStream either sees it or has not drained yet
+        if(client->streamQueued_ >= MaxStreamQueued)
+        {
+            client->streamPaused_ = true;
+            if(client->streamQueued_ >= MaxStreamQueued)
+                return CURL_WRITEFUNC_PAUSE; // curl hands the same data over again once resumed
+            client->streamPaused_ = false;
+        }
+
+        auto chunk = std::make_shared<Batang::ChunkBuffer>();
+        bool decoded = client->streamDecoder_.decode(static_cast<const char *>(data), realSize,
+            [&chunk](const char *decodedData, size_t decodedSize) { chunk->append(decodedData, decodedSize); });
+        {
+            std::lock_guard<std::mutex> lock(client->statsMutex_);
+            client->streamStats_.decoding_ = client->streamDecoder_.stats();
+        }
+        if(!decoded) // ends the transfer, and the stream reconnects
+            return 0;
+
+        if(!chunk->empty())
+        {
+            // charged by the pool chunks it pins, which a write of a few hundred bytes fills but little of
+            client->streamQueued_ += chunk->chunkCount() * Batang::ChunkPool::ChunkSize;
+            client->post([client, chunk]() { client->receiveStream(*chunk); });
+        }
+        return realSize;
+    }
+
+    size_t TwitterClient::streamHeaderCallback(char *data, size_t size, size_t nmemb, void *param)
+    {
+        // called on the reactor thread before the body
+        TwitterClient *client = static_cast<TwitterClient *>(param);
+        size_t realSize = size * nmemb;
+
+        ContentDecoder::Encoding encoding;
+        if(ContentDecoder::parseHeader(boost::string_view(data, realSize), encoding))
+            client->streamDecoder_.start(encoding);
+        return realSize;
+    }
+
     size_t TwitterClient::curlWriteCallback(void *data, size_t size, size_t nmemb, void *param)
     {
         CurlWriteCallbackData *cbd_ = static_cast<CurlWriteCallbackData *>(param);
         size_t realSize = size * nmemb;
 
-        cbd_->data.insert(cbd_->data.end(), static_cast<uint8_t *>(data), static_cast<uint8_t *>(data) + realSize);
+        if(!cbd_->decoder.decode(static_cast<const char *>(data), realSize,
+            [cbd_](const char *decodedData, size_t decodedSize) { cbd_->data.append(decodedData, decodedSize); }))
+            return 0; // corrupt or in an encoding not asked for; the transfer fails
 
         if(cbd_->cb)
             cbd_->cb(cbd_->data.size());
@@ -104,6 +224,21 @@ namespace Maragi
         return realSize;
     }
 
+    size_t TwitterClient::curlHeaderCallback(char *data, size_t size, size_t nmemb, void *param)
+    {
+        // called on the reactor thread while sendRequest waits for the transfer
+        TwitterClient *client = static_cast<TwitterClient *>(param);
+        size_t realSize = size * nmemb;
+
+        boost::string_view line(data, realSize);
+        ContentDecoder::Encoding encoding;
+        if(client->rateLimit_.parseHeader(line) || client->validators_.parseHeader(line))
+            return realSize;
+        else if(ContentDecoder::parseHeader(line, encoding))
+            client->cbd_.decoder.start(encoding);
+        return realSize;
+    }
+
     namespace
     {
         std::string join(const std::vector<std::string> &ve, const std::string &sep)
@@ -132,173 +267,19 @@ namespace Maragi
             return Url(uri);
         }
 
-        class CryptProvider : public Batang::Singleton<CryptProvider>
+        // Writes the header into out, replacing what it held, so a buffer kept by the caller is reused.
+        void makeOAuthHeader(const UrlParams &field, std::string &out)
         {
-        private:
-            HCRYPTPROV cp;
-
-        public:
-            CryptProvider(const wchar_t *containerName = nullptr)
-            {
-                if(!CryptAcquireContextW(&cp, containerName, nullptr, PROV_RSA_FULL, 0))
-                {
-                    if(GetLastError() == NTE_BAD_KEYSET)
-                    {
-                        if(!CryptAcquireContextW(&cp, containerName, nullptr, PROV_RSA_FULL, CRYPT_NEWKEYSET))
-                            throw(std::runtime_error("Cannot initialize pseudo-random number generator."));
-                    }
-                    else
-                        throw(std::runtime_error("Cannot initialize pseudo-random number generator."));
-                }
-            }
-
-            ~CryptProvider()
-            {
-                CryptReleaseContext(cp, 0);
-            }
-
-            HCRYPTPROV get()
-            {
-                return cp;
-            }
-        };
-
-        std::string toBase(unsigned long long num, int radix)
-        {
-            static const char digit[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
-            std::string str;
-            do
-            {
-                str += digit[num % radix];
-                num /= radix;
-            }
-            while(num != 0);
-            return str;
-        }
-
-        std::string generateNonce()
-        {
-            static CryptProvider cp(L"MaragiPRNG");
-            unsigned long long rnd = 0;
-            if(!CryptGenRandom(cp.get(), sizeof(rnd), reinterpret_cast<uint8_t *>(&rnd)))
-                throw(std::runtime_error("Cannot generate pseudo-random number."));
-            return toBase(rnd, 62);
-        }
-
-        std::string HmacSha1(const std::vector<uint8_t> &key, const std::vector<uint8_t> &message)
-        {
-            std::vector<uint8_t> normKey(20);
-
-            if(key.size() > 64)
-                SHA1(&*key.begin(), key.size(), &*normKey.begin());
-            else
-                normKey = key;
-
-            std::vector<uint8_t> ipad = normKey, opad = normKey;
-            ipad.resize(64); opad.resize(64);
-
-            for(size_t i = 0; i < 64; ++ i)
+            out.assign("Authorization: OAuth ");
+            for(auto it = field.begin(); it != field.end(); ++ it)
             {
-                ipad[i] ^= 0x36;
-                opad[i] ^= 0x5C;
+                if(it != field.begin())
+                    out += ", ";
+                Batang::encodeUrl(it->first, out);
+                out += "=\"";
+                Batang::encodeUrl(it->second, out);
+                out += "\"";
             }
-
-            std::vector<uint8_t> result(20);
-
-            ipad.insert(ipad.end(), message.begin(), message.end());
-            SHA1(&*ipad.begin(), ipad.size(), &*result.begin());
-
-            opad.insert(opad.end(), result.begin(), result.end());
-            SHA1(&*opad.begin(), opad.size(), &*result.begin());
-
-            return Batang::base64Encode(result);
-        }
-
-        std::string makePostField(const std::map<std::string, std::string> &field)
-        {
-            std::string text;
-            if(!field.empty())
-            {
-                auto it = field.begin();
-                text += Batang::encodeUrlParam(it->first);
-                text += "=";
-                text += Batang::encodeUrlParam(it->second);
-                for(++ it; it != field.end(); ++ it)
-                {
-                    text += "&";
-                    text += Batang::encodeUrlParam(it->first);
-                    text += "=";
-                    text += Batang::encodeUrlParam(it->second);
-                }
-            }
-
-            return text;
-        }
-
-        std::string makeOAuthHeader(const std::map<std::string, std::string> &field)
-        {
-            std::string text = "Authorization: OAuth ";
-            if(!field.empty())
-            {
-                auto it = field.begin();
-                text += Batang::encodeUrl(it->first);
-                text += "=\"";
-                text += Batang::encodeUrl(it->second);
-                text += "\"";
-                for(++ it; it != field.end(); ++ it)
-                {
-                    text += ", ";
-                    text += Batang::encodeUrl(it->first);
-                    text += "=\"";
-                    text += Batang::encodeUrl(it->second);
-                    text += "\"";
-                }
-            }
-
-            return text;
-        }
-
-        std::string signRequestUrl(Url &uri, const std::string &tokenSecret = std::string())
-        {
-            FILETIME ft;
-            GetSystemTimeAsFileTime(&ft);
-            unsigned long long ts = (static_cast<unsigned long long>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
-            ts -= 116444736000000000;
-            ts /= 10000000;
-
-            std::stringstream s;
-            s << ts;
-
-            std::string nonce = generateNonce();
-
-            uri.addOAuthParam("oauth_consumer_key", AppTokens::CONSUMER_KEY);
-            uri.addOAuthParam("oauth_version", "1.0");
-            uri.addOAuthParam("oauth_timestamp", s.str());
-            uri.addOAuthParam("oauth_nonce", nonce);
-            uri.addOAuthParam("oauth_signature_method", "HMAC-SHA1");
-            uri.removeOAuthParam("oauth_signature");
-
-            std::string message = "POST&";
-            message += Batang::encodeUrl(uri.baseUrl());
-            message += "&";
-            std::map<std::string, std::string> totalParams = uri.params();
-            const auto &oauthParams = uri.oauthParams();
-            totalParams.insert(oauthParams.begin(), oauthParams.end());
-            message += Batang::encodeUrl(makePostField(totalParams));
-
-            std::string key = Batang::encodeUrl(AppTokens::CONSUMER_SECRET);
-            key += "&";
-            key += Batang::encodeUrl(tokenSecret);
-
-            uri.addOAuthParam(
-                "oauth_signature",
-                HmacSha1(
-                    std::vector<uint8_t>(key.begin(), key.end()),
-                    std::vector<uint8_t>(message.begin(), message.end())
-                )
-            );
-
-            return nonce;
         }
 
         template<typename It>
@@ -326,7 +307,7 @@ namespace Maragi
         }
 
         // TODO: Separate the dialog into whole complete class and file.
-        class ConfirmDialog : public Gurigi::Dialog, public Batang::Singleton<ConfirmDialog>
+        class ConfirmDialog : public Gurigi::Dialog, public Batang::Singleton<ConfirmDialog, Batang::DestructPriority::Normal, Batang::ExitBehavior::Skip>
         {
         private:
             ConfirmDialog() : Dialog(nullptr) {}
@@ -403,7 +384,7 @@ namespace Maragi
                 return 0;
             }
 
-            friend class Batang::Singleton<ConfirmDialog>;
+            friend class Batang::Singleton<ConfirmDialog, Batang::DestructPriority::Normal, Batang::ExitBehavior::Skip>;
         };
     }
 
@@ -415,7 +396,7 @@ namespace Maragi
 
             Url uri = makeRequestUrl(Paths::REQUEST_TOKEN);
             uri.addOAuthParam("oauth_callback", "oob");
-            signRequestUrl(uri);
+            OAuthSigner(AppTokens::CONSUMER_KEY, AppTokens::CONSUMER_SECRET, std::string()).sign(uri);
             sendRequest(uri);
 
             std::map<std::string, std::string> recvParams = parsePostField(cbd_.data.begin(), cbd_.data.end());
@@ -432,10 +413,10 @@ namespace Maragi
             uri = makeRequestUrl(Paths::ACCESS_TOKEN);
             uri.addOAuthParam("oauth_token", token);
             uri.addOAuthParam("oauth_verifier", Batang::encodeUtf8(cfd.text()));
-            signRequestUrl(uri, tokenSecret);
+            OAuthSigner(AppTokens::CONSUMER_KEY, AppTokens::CONSUMER_SECRET, tokenSecret).sign(uri);
             sendRequest(uri);
 
-            std::string fields(cbd_.data.begin(), cbd_.data.end());
+            std::string fields = cbd_.data.str();
             MessageBoxA(nullptr, fields.c_str(), "Access Token", MB_OK);
         });
     }
@@ -460,24 +441,438 @@ namespace Maragi
         return accessTokenSecret_;
     }
 
+    void TwitterClient::streamUrl(const std::string &url)
+    {
+        post([this, url]() { streamUrl_ = url; });
+    }
+
+    void TwitterClient::scheduleRequest(Url uri, RequestScheduler::Priority priority, RequestHandler onDone, const char *methodName)
+    {
+        auto request = std::make_shared<Url>(std::move(uri));
+        std::string method = methodName; // the tasks below run long after the caller's string may have gone
+        post([this, request, priority, onDone, method]()
+        {
+            {
+                std::lock_guard<std::mutex> lock(statsMutex_);
+                ++ requestStats_.requests_;
+            }
+
+            std::string key; // empty for requests which must not be coalesced or cached
+            std::shared_ptr<const ResponseCache::Entry> cached;
+            bool sinceId = false;
+            if(method == "GET")
+            {
+                key = request->compose();
+                auto result = coalescing_.emplace(key, Coalesced());
+                Coalesced &coalesced = result.first->second;
+                coalesced.waiters_.push_back(onDone);
+                if(!result.second)
+                {
+                    // a foreground refresh must not wait out the pacing of a prefetch it joined
+                    if(priority < coalesced.priority_)
+                    {
+                        coalesced.priority_ = priority;
+                        RequestScheduler::instance().raise(coalesced.ticket_, priority);
+                    }
+
+                    std::lock_guard<std::mutex> lock(statsMutex_);
+                    ++ requestStats_.coalesced_;
+                    return;
+                }
+                coalesced.priority_ = priority;
+
+                // the key stays the URL as asked for, so the next refresh finds the merged timeline
+                cached = responseCache_.find(key);
+                if(cached && cached->newestId_ != 0 && !request->hasParam("since_id") && !request->hasParam("max_id"))
+                {
+                    request->setParam("since_id", std::to_string(cached->newestId_));
+                    sinceId = true;
+                }
+            }
+
+            auto ticket = RequestScheduler::instance().schedule(accessToken_, request->baseUrl(), priority, sharedFromThis(),
+                [this, request, onDone, method, key, cached, sinceId](RequestScheduler::Ticket ticket)
+            {
+                bool sent;
+                try
+                {
+                    request->setOAuthParam("oauth_token", accessToken_);
+                    signer_.sign(*request, method.c_str());
+                    sent = sendRequest(*request, method.c_str(), cached && !sinceId ? &cached->validators_ : nullptr);
+                }
+                catch(...)
+                {
+                    // the scheduler holds a turn of the window for this request until it hears back
+                    RequestScheduler::instance().finish(ticket, RateLimit(), 0);
+
+                    // and every caller waits for an answer, those which joined this GET included
+                    std::vector<RequestHandler> waiters;
+                    if(key.empty())
+                        waiters.push_back(onDone);
+                    else
+                    {
+                        auto it = coalescing_.find(key);
+                        waiters = std::move(it->second.waiters_);
+                        coalescing_.erase(it);
+                    }
+
+                    Batang::ChunkBuffer none;
+                    for(auto &waiter: waiters)
+                        waiter(Failed, none);
+                    throw;
+                }
+
+                long status = 0;
+                curl_easy_getinfo(curl_, CURLINFO_RESPONSE_CODE, &status);
+                RequestScheduler::instance().finish(ticket, rateLimit_, status);
+                if(status == 429) // sent again when the window allows
+                    return;
+
+                size_t received = cbd_.data.size(); // before ResponseCache fills in what was not sent
+                ResponseState state = Failed;
+                if(sent && !key.empty())
+                    state = cacheResponse(*request, key, cached.get(), sinceId, status);
+                else if(sent && status == 200)
+                    state = Received;
+
+                std::vector<RequestHandler> waiters;
+                if(key.empty())
+                    waiters.push_back(onDone);
+                else
+                {
+                    auto it = coalescing_.find(key);
+                    waiters = std::move(it->second.waiters_);
+                    coalescing_.erase(it);
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(statsMutex_);
+                    ++ requestStats_.transfers_;
+                    requestStats_.bytes_ += received;
+                    requestStats_.coalescedBytes_ += cbd_.data.size() * (waiters.size() - 1);
+                }
+
+                for(auto &waiter: waiters)
+                    waiter(state, cbd_.data);
+            });
+            if(!key.empty()) // the task runs on this thread, so not before this
+                coalescing_[key].ticket_ = ticket;
+        });
+    }
+
+    TwitterClient::StreamStats TwitterClient::streamStats() const
+    {
+        std::lock_guard<std::mutex> lock(statsMutex_);
+        return streamStats_;
+    }
+
+    TwitterClient::RequestStats TwitterClient::requestStats() const
+    {
+        std::lock_guard<std::mutex> lock(statsMutex_);
+        return requestStats_;
+    }
+
+    void TwitterClient::stop()
+    {
+        postQuitProcess();
+    }
+
     void TwitterClient::run()
     {
-        // TODO: twitter stream
+        post([this]()
+        {
+            restoreHome();
+            openStream();
+        });
+        pump();
+
+        Batang::Timer::instance().uninstallTimer(streamRetryTimer_);
+        closeStream();
+        flushStreamBatch();
     }
 
-    bool TwitterClient::sendRequest(const Url &uri)
+    bool TwitterClient::sendRequest(const Url &uri, const char *method, const Validators *validators)
     {
-        curl_easy_setopt(curl_, CURLOPT_URL, uri.baseUrl().c_str());
-        curl_easy_setopt(curl_, CURLOPT_POSTFIELDS, makePostField(uri.params()).c_str());
+        if(std::strcmp(method, "GET") == 0)
+        {
+            curl_easy_setopt(curl_, CURLOPT_URL, uri.compose().c_str());
+            curl_easy_setopt(curl_, CURLOPT_HTTPGET, 1l);
+        }
+        else
+        {
+            // curl reads the body while performing without copying it, so it lives in a member
+            requestBody_.clear();
+            uri.params().encode(requestBody_);
+            curl_easy_setopt(curl_, CURLOPT_URL, uri.baseUrl().c_str());
+            curl_easy_setopt(curl_, CURLOPT_POSTFIELDSIZE, static_cast<long>(requestBody_.size()));
+            curl_easy_setopt(curl_, CURLOPT_POSTFIELDS, requestBody_.c_str());
+        }
 
-        curl_slist *header = curl_slist_append(nullptr, makeOAuthHeader(uri.oauthParams()).c_str());
+        makeOAuthHeader(uri.oauthParams(), requestHeader_);
+        curl_slist *header = curl_slist_append(nullptr, requestHeader_.c_str());
+        if(validators && !validators->etag_.empty())
+            header = curl_slist_append(header, ("If-None-Match: " + validators->etag_).c_str());
+        if(validators && !validators->lastModified_.empty())
+            header = curl_slist_append(header, ("If-Modified-Since: " + validators->lastModified_).c_str());
         curl_easy_setopt(curl_, CURLOPT_HTTPHEADER, header);
 
         cbd_.data.clear();
+        cbd_.decoder.start(ContentDecoder::Identity); // until the response says otherwise
+        rateLimit_ = RateLimit();
+        validators_ = Validators();
 
-        CURLcode res = curl_easy_perform(curl_);
+        CURLcode res = NetworkReactor::instance().perform(curl_);
         curl_slist_free_all(header);
 
+        {
+            std::lock_guard<std::mutex> lock(statsMutex_);
+            requestStats_.decoding_ = cbd_.decoder.stats();
+        }
+
         return res == CURLE_OK;
     }
+
+    TwitterClient::ResponseState TwitterClient::cacheResponse(const Url &uri, const std::string &key,
+        const ResponseCache::Entry *cached, bool sinceId, long status)
+    {
+        // cbd_.data holds the response as received and is left holding the whole of it
+        bool unchanged = cached && ((!sinceId && status == 304)
+            || (sinceId && status == 200 && cbd_.data.size() < 16 && Batang::trimView(cbd_.data.str()) == "[]"));
+        if(unchanged)
+        {
+            cbd_.data.clear();
+            cbd_.data.append(cached->body_.data(), cached->body_.size());
+
+            std::lock_guard<std::mutex> lock(statsMutex_);
+            ++ requestStats_.notModified_;
+            if(sinceId)
+                ++ requestStats_.incremental_;
+            requestStats_.cachedBytes_ += cached->body_.size();
+            return NotModified;
+        }
+        else if(status != 200)
+            return Failed;
+
+        auto entry = std::make_shared<ResponseCache::Entry>();
+        entry->body_ = cbd_.data.str();
+        if(homeCache_ && boost::string_view(uri.baseUrl()).ends_with(Paths::HOME_TIMELINE))
+            cacheHomeResponse(entry->body_); // the newer part alone when sinceId; the rest is on disk already
+        if(sinceId)
+        {
+            size_t count = uri.hasParam("count") ? std::strtoul(uri.getParam("count").c_str(), nullptr, 10) : DefaultTimelineCount;
+            std::string merged;
+            // not a timeline after all, such as an error object; the newer part alone must not replace the
+            // whole, and the cached entry stays for the next refresh
+            if(!ResponseCache::mergeTimeline(entry->body_, cached->body_, count, merged))
+                return Failed;
+
+            {
+                std::lock_guard<std::mutex> lock(statsMutex_);
+                ++ requestStats_.incremental_;
+                requestStats_.cachedBytes_ += merged.size() - std::min(merged.size(), entry->body_.size());
+            }
+
+            entry->body_.swap(merged);
+            cbd_.data.clear();
+            cbd_.data.append(entry->body_.data(), entry->body_.size());
+        }
+
+        entry->validators_ = validators_;
+        entry->newestId_ = ResponseCache::incremental(uri.baseUrl()) ? ResponseCache::newestId(entry->body_) : 0;
+        if(!entry->validators_.empty() || entry->newestId_ != 0) // nothing to revalidate with otherwise
+            responseCache_.store(key, entry);
+        return Received;
+    }
+
+    void TwitterClient::openStream()
+    {
+        if(streamCurl_ || !authorized())
+            return;
+
+        Url uri(streamUrl_);
+        uri.addOAuthParam("oauth_token", accessToken_);
+        signer_.sign(uri, "GET");
+
+        streamCurl_ = curl_easy_init();
+        if(streamCurl_ == nullptr)
+            throw(std::runtime_error("CURL initialization failed."));
+
+        CurlShare::instance().attach(streamCurl_);
+        makeOAuthHeader(uri.oauthParams(), requestHeader_);
+        streamHeader_ = curl_slist_append(nullptr, requestHeader_.c_str());
+
+        curl_easy_setopt(streamCurl_, CURLOPT_URL, uri.compose().c_str());
+        curl_easy_setopt(streamCurl_, CURLOPT_HTTPGET, 1l);
+        curl_easy_setopt(streamCurl_, CURLOPT_HTTPHEADER, streamHeader_);
+        curl_easy_setopt(streamCurl_, CURLOPT_NOPROGRESS, 1l);
+        curl_easy_setopt(streamCurl_, CURLOPT_USERAGENT, Batang::encodeUtf8(Constants::USER_AGENT).c_str());
+        curl_easy_setopt(streamCurl_, CURLOPT_WRITEFUNCTION, &streamWriteCallback);
+        curl_easy_setopt(streamCurl_, CURLOPT_WRITEDATA, static_cast<void *>(this));
+        curl_easy_setopt(streamCurl_, CURLOPT_HEADERFUNCTION, &streamHeaderCallback);
+        curl_easy_setopt(streamCurl_, CURLOPT_HEADERDATA, static_cast<void *>(this));
+        curl_easy_setopt(streamCurl_, CURLOPT_ACCEPT_ENCODING, ContentDecoder::AcceptEncoding);
+        curl_easy_setopt(streamCurl_, CURLOPT_HTTP_CONTENT_DECODING, 0l); // inflated a write at a time into the framer
+        curl_easy_setopt(streamCurl_, CURLOPT_TCP_KEEPALIVE, 1l);
+
+        // keep-alive newlines come every 30 seconds; three missing in a row means a stalled connection
+        curl_easy_setopt(streamCurl_, CURLOPT_LOW_SPEED_LIMIT, 1l);
+        curl_easy_setopt(streamCurl_, CURLOPT_LOW_SPEED_TIME, 90l);
+
+        setTlsVerification(streamCurl_);
+
+        streamFramer_.reset();
+        streamDecoder_.start(ContentDecoder::Identity);
+        streamPaused_ = false; // chunks of the last connection still queued count against this one
+        NetworkReactor::instance().add(streamCurl_, sharedFromThis(), [this](CURLcode result, long status)
+        {
+            closeStream();
+            streamRetryTimer_ = Batang::Timer::instance().installRunOnceTimer(sharedFromThis(),
+                std::chrono::steady_clock::now() + nextStreamDelay(result, status), [this]() { openStream(); });
+        });
+
+        std::lock_guard<std::mutex> lock(statsMutex_);
+        ++ streamStats_.connects_;
+    }
+
+    void TwitterClient::closeStream()
+    {
+        if(!streamCurl_)
+            return;
+
+        NetworkReactor::instance().remove(streamCurl_);
+        curl_easy_cleanup(streamCurl_);
+        curl_slist_free_all(streamHeader_);
+        streamCurl_ = nullptr;
+        streamHeader_ = nullptr;
+    }
+
+    void TwitterClient::receiveStream(const Batang::ChunkBuffer &data)
+    {
+        streamBackoff_ = StreamBackoff(); // connected; start over the next time it drops
+
+        // the reactor paused the stream while this thread fell behind; it goes on once half is drained.
+        // Settled before the messages are, so one that throws cannot leave the stream paused.
+        if((streamQueued_ -= data.chunkCount() * Batang::ChunkPool::ChunkSize) < MaxStreamQueued / 2 && streamPaused_.exchange(false) && streamCurl_)
+            NetworkReactor::instance().resume(streamCurl_);
+
+        size_t messages = 0, discarded = streamFramer_.discardedCount();
+        for(size_t i = 0; i < data.chunkCount(); ++ i)
+        {
+            auto chunk = data.chunk(i);
+            streamFramer_.feed(chunk.data(), chunk.size(), [this, &messages](boost::string_view message)
+            {
+                ++ messages;
+                onStreamMessage(message);
+            });
+        }
+
+        std::lock_guard<std::mutex> lock(statsMutex_);
+        streamStats_.bytes_ += data.size();
+        streamStats_.messages_ += messages;
+        streamStats_.discarded_ += streamFramer_.discardedCount() - discarded;
+    }
+
+    void TwitterClient::onStreamMessage(boost::string_view message)
+    {
+        // friends lists, deletions, limit notices, ... are not statuses and are dropped here
+        if(!streamJson_.parse(message) || !streamBatch_->addStatus(streamJson_.root()))
+            return;
+
+        if(streamBatch_->size() == 1)
+        {
+            streamBatchTimer_ = Batang::Timer::instance().installRunOnceTimer(sharedFromThis(),
+                std::chrono::steady_clock::now() + StreamBatchDelay, [this]() { flushStreamBatch(); });
+        }
+        else if(streamBatch_->size() >= MaxStreamBatch)
+            flushStreamBatch();
+    }
+
+    void TwitterClient::flushStreamBatch()
+    {
+        Batang::Timer::instance().uninstallTimer(streamBatchTimer_);
+        streamBatchTimer_ = Batang::Timer::TaskId();
+        if(streamBatch_->empty())
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock(statsMutex_);
+            streamStats_.statuses_ += streamBatch_->size();
+        }
+
+        streamBatch_->compact();
+        std::shared_ptr<const TweetBatch> batch = std::move(streamBatch_);
+        streamBatch_ = std::make_shared<TweetBatch>();
+
+        cacheHome(*batch);
+        onStreamBatch(batch);
+        for(auto &tweet: batch->tweets())
+            onStreamAdd(tweet);
+    }
+
+    void TwitterClient::restoreHome()
+    {
+        if(!homeCache_)
+            return;
+
+        auto batch = homeCache_->loadRecent(HomeRestoreCount);
+        {
+            std::lock_guard<std::mutex> lock(statsMutex_);
+            streamStats_.restored_ += batch->size();
+            streamStats_.homeCache_ = homeCache_->stats();
+        }
+
+        if(!batch->empty())
+            onHomeRestored(batch);
+    }
+
+    void TwitterClient::cacheHomeResponse(boost::string_view timeline)
+    {
+        JsonDocument json;
+        if(!json.parse(timeline))
+            return;
+
+        TweetBatch batch;
+        json.root().forEach([&batch](const JsonValue &status) { batch.addStatus(status); });
+        cacheHome(batch);
+    }
+
+    void TwitterClient::cacheHome(const TweetBatch &batch)
+    {
+        if(!homeCache_ || batch.empty())
+            return;
+
+        try
+        {
+            homeCache_->append(batch);
+        }
+        catch(const std::runtime_error &)
+        {
+            // a disk which failed once is not tried for every batch after
+            homeCache_.reset();
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(statsMutex_);
+        streamStats_.homeCache_ = homeCache_->stats();
+    }
+
+    std::chrono::milliseconds TwitterClient::nextStreamDelay(CURLcode result, long status)
+    {
+        using std::chrono::milliseconds;
+
+        if(status == 420 || status == 429)
+        {
+            streamBackoff_.rateLimit_ = streamBackoff_.rateLimit_.count() == 0 ? milliseconds(60000) : streamBackoff_.rateLimit_ * 2;
+            return streamBackoff_.rateLimit_;
+        }
+        else if(result == CURLE_OK && status >= 400)
+        {
+            streamBackoff_.http_ = streamBackoff_.http_.count() == 0 ? milliseconds(5000) : std::min(streamBackoff_.http_ * 2, milliseconds(320000));
+            return streamBackoff_.http_;
+        }
+
+        // network trouble, or the server simply closed the stream
+        streamBackoff_.network_ = std::min(streamBackoff_.network_ + milliseconds(250), milliseconds(16000));
+        return streamBackoff_.network_;
+    }
 }
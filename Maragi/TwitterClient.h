@@ -1,8 +1,18 @@
 ﻿#pragma once
 
+#include "../Batang/ChunkBuffer.h"
 #include "../Batang/Event.h"
 #include "../Batang/Thread.h"
+#include "../Batang/Timer.h"
 
+#include "ContentDecoder.h"
+#include "Json.h"
+#include "OAuthSigner.h"
+#include "RequestScheduler.h"
+#include "ResponseCache.h"
+#include "StreamFramer.h"
+#include "Tweet.h"
+#include "TweetCache.h"
 #include "Url.h"
 #include "TwitterClientError.h"
 
@@ -11,26 +21,103 @@ namespace Maragi
     class TwitterClient : public Batang::Thread<TwitterClient>
     {
     public:
-        struct TwitterEventArg
+        struct StreamStats
         {
-            std::wstring authorId_;
-            std::wstring authorName_;
-            std::wstring text_;
+            uint64_t bytes_;
+            uint64_t messages_;
+            uint64_t statuses_;
+            uint64_t discarded_; // messages over the framing limit
+            uint64_t connects_;
+            ContentDecoder::Stats decoding_; // of every stream connection so far
+            uint64_t restored_; // statuses onHomeRestored gave from disk before the stream opened
+            TweetCache::Stats homeCache_; // zero without a home timeline cache
         };
 
+        struct RequestStats
+        {
+            uint64_t requests_; // handed to scheduleRequest()
+            uint64_t transfers_;
+            uint64_t coalesced_; // GETs which joined an identical one in flight
+            uint64_t bytes_; // response bodies received
+            uint64_t coalescedBytes_; // bodies the coalesced GETs would have received again
+            uint64_t notModified_; // GETs answered from ResponseCache
+            uint64_t incremental_; // GETs which asked for statuses newer than the cached ones only
+            uint64_t cachedBytes_; // bodies, or parts of them, taken from ResponseCache instead of the network
+            ContentDecoder::Stats decoding_; // of the request connection
+        };
+
+        enum ResponseState
+        {
+            Failed,
+            Received,
+            NotModified, // the body is the one the handler was given last time; there is nothing new to parse
+        };
+
+        // Called on the client thread; the body is valid during the call only.
+        typedef std::function<void (ResponseState, const Batang::ChunkBuffer &)> RequestHandler;
+
     private:
-        typedef Batang::Event<TwitterEventArg> TwitterEvent;
+        typedef Batang::Event<TweetRecord> TweetEvent;
+        typedef Batang::Event<std::shared_ptr<const TweetBatch>> TweetBatchEvent;
         struct CurlWriteCallbackData
         {
             TwitterClient *client;
-            std::vector<uint8_t> data;
+            Batang::ChunkBuffer data; // recycled across requests through Batang::ChunkPool
+            ContentDecoder decoder; // decodes into data on the reactor thread
             std::function<void (size_t)> cb;
         };
 
+        struct Coalesced // a GET in flight and the callers sharing it
+        {
+            std::vector<RequestHandler> waiters_;
+            RequestScheduler::Priority priority_; // the highest any waiter asked for
+            RequestScheduler::Ticket ticket_;
+        };
+
+        struct StreamBackoff // reconnection delays as the streaming API asks for them
+        {
+            std::chrono::milliseconds network_; // linear, for TCP/IP level errors
+            std::chrono::milliseconds http_; // exponential, for HTTP errors
+            std::chrono::milliseconds rateLimit_; // exponential, for 420/429
+        };
+
     private:
+        static const size_t MaxStreamBatch;
+        static const size_t MaxStreamQueued; // pool bytes of decoded data posted to this thread before the stream is paused
+        static const size_t DefaultTimelineCount; // statuses a timeline answers with when count is not given
+        static const size_t HomeRestoreCount; // statuses given to onHomeRestored at most
+        static const std::chrono::milliseconds StreamBatchDelay;
+
         CURL *curl_;
         CurlWriteCallbackData cbd_;
         std::string screenName_, accessToken_, accessTokenSecret_;
+        OAuthSigner signer_; // for the access token; touched on this client's thread only
+        std::string requestBody_, requestHeader_; // reused across requests on this client's thread
+        RateLimit rateLimit_; // of the last response to curl_
+        Validators validators_; // of the last response to curl_
+        ResponseCache responseCache_; // on this client's thread
+        std::unordered_map<std::string, Coalesced> coalescing_; // GETs in flight by URL; on this client's thread
+        // the home timeline as streamed and fetched, null without a screen name or once it cannot be written;
+        // on this client's thread
+        std::unique_ptr<TweetCache> homeCache_;
+
+        // streaming state; touched on this client's thread only
+        CURL *streamCurl_;
+        curl_slist *streamHeader_;
+        ContentDecoder streamDecoder_; // on the reactor thread while the stream is open
+        std::atomic<size_t> streamQueued_; // posted by streamWriteCallback, not yet through receiveStream
+        std::atomic<bool> streamPaused_;
+        std::string streamUrl_;
+        StreamFramer streamFramer_;
+        JsonDocument streamJson_; // keeps its index allocation across messages
+        std::shared_ptr<TweetBatch> streamBatch_;
+        Batang::Timer::TaskId streamBatchTimer_;
+        StreamBackoff streamBackoff_;
+        Batang::Timer::TaskId streamRetryTimer_;
+
+        mutable std::mutex statsMutex_;
+        StreamStats streamStats_;
+        RequestStats requestStats_;
 
     public:
         TwitterClient();
@@ -38,8 +125,17 @@ namespace Maragi
         TwitterClient(const TwitterClient &) = delete;
         ~TwitterClient();
 
+    public:
+        static void initializeCurl();
+
+    public:
+        virtual std::string name() const override;
+
     private:
         static size_t curlWriteCallback(void *, size_t, size_t, void *);
+        static size_t curlHeaderCallback(char *, size_t, size_t, void *);
+        static size_t streamWriteCallback(void *, size_t, size_t, void *);
+        static size_t streamHeaderCallback(char *, size_t, size_t, void *);
 
     public:
         void authorize();
@@ -47,15 +143,38 @@ namespace Maragi
         const std::string &screenName() const;
         const std::string &accessToken() const;
         const std::string &accessTokenSecret() const;
+        void streamUrl(const std::string &); // takes effect on the next connection
+        // Signs and sends the request when RequestScheduler gives it a turn. method is a string literal.
+        // A GET identical to one in flight shares its transfer, raised to the highest priority of those sharing it,
+        // and onDone is called with its response.
+        // GETs are revalidated against ResponseCache, and timelines fetch only what is newer than the cached
+        // response; onDone always gets the whole response.
+        void scheduleRequest(Url uri, RequestScheduler::Priority priority, RequestHandler onDone, const char *methodName = "POST");
+        StreamStats streamStats() const;
+        RequestStats requestStats() const;
+        void stop();
 
     public:
-        TwitterEvent onStreamAdd;
+        TweetEvent onStreamAdd; // the record lives as long as the batch
+        TweetBatchEvent onStreamBatch; // the same statuses, once per batch; keep the batch to keep them
+        TweetBatchEvent onHomeRestored; // the newest of the home timeline as last shown, from disk, once before the stream opens
 
     private:
         void run();
 
     private:
-        bool sendRequest(const Url &uri);
+        bool sendRequest(const Url &uri, const char *method = "POST", const Validators *validators = nullptr);
+        ResponseState cacheResponse(const Url &uri, const std::string &key, const ResponseCache::Entry *cached, bool sinceId, long status);
+
+        void openStream();
+        void closeStream();
+        void receiveStream(const Batang::ChunkBuffer &);
+        void onStreamMessage(boost::string_view);
+        void flushStreamBatch();
+        void restoreHome();
+        void cacheHomeResponse(boost::string_view timeline);
+        void cacheHome(const TweetBatch &);
+        std::chrono::milliseconds nextStreamDelay(CURLcode, long);
 
         friend class Batang::Thread<TwitterClient>;
     };
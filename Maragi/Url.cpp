@@ -6,19 +6,115 @@
 
 namespace Maragi
 {
+    UrlParams::UrlParams()
+    {
+    }
+
+    UrlParams::UrlParams(std::initializer_list<value_type> items)
+    {
+        items_.reserve(items.size());
+        for(auto &item: items)
+            insert(item.first, item.second);
+    }
+
+    UrlParams::const_iterator UrlParams::begin() const
+    {
+        return items_.begin();
+    }
+
+    UrlParams::const_iterator UrlParams::end() const
+    {
+        return items_.end();
+    }
+
+    size_t UrlParams::size() const
+    {
+        return items_.size();
+    }
+
+    bool UrlParams::empty() const
+    {
+        return items_.empty();
+    }
+
+    UrlParams::const_iterator UrlParams::find(boost::string_view key) const
+    {
+        auto it = std::lower_bound(items_.begin(), items_.end(), key,
+            [](const value_type &item, boost::string_view key) { return boost::string_view(item.first) < key; });
+        if(it != items_.end() && it->first == key)
+            return it;
+        return items_.end();
+    }
+
+    bool UrlParams::insert(boost::string_view key, boost::string_view value)
+    {
+        auto it = lowerBound(key);
+        if(it != items_.end() && it->first == key)
+            return false;
+
+        items_.emplace(it, std::string(key.begin(), key.end()), std::string(value.begin(), value.end()));
+        return true;
+    }
+
+    void UrlParams::set(boost::string_view key, boost::string_view value)
+    {
+        auto it = lowerBound(key);
+        if(it != items_.end() && it->first == key)
+            it->second.assign(value.data(), value.size());
+        else
+            items_.emplace(it, std::string(key.begin(), key.end()), std::string(value.begin(), value.end()));
+    }
+
+    bool UrlParams::erase(boost::string_view key)
+    {
+        auto it = lowerBound(key);
+        if(it == items_.end() || it->first != key)
+            return false;
+
+        items_.erase(it);
+        return true;
+    }
+
+    void UrlParams::clear()
+    {
+        items_.clear();
+    }
+
+    void UrlParams::encode(std::string &out) const
+    {
+        // escaping only grows the text, so this is the least it can take
+        size_t size = out.size() + (items_.empty() ? 0 : items_.size() * 2 - 1);
+        for(auto &item: items_)
+            size += item.first.size() + item.second.size();
+        out.reserve(size);
+
+        for(auto it = items_.begin(); it != items_.end(); ++ it)
+        {
+            if(it != items_.begin())
+                out += '&';
+            Batang::encodeUrlParam(it->first, out);
+            out += '=';
+            Batang::encodeUrlParam(it->second, out);
+        }
+    }
+
+    std::vector<UrlParams::value_type>::iterator UrlParams::lowerBound(boost::string_view key)
+    {
+        return std::lower_bound(items_.begin(), items_.end(), key,
+            [](const value_type &item, boost::string_view key) { return boost::string_view(item.first) < key; });
+    }
+
     Url::Url()
         : changed_(true)
     {
     }
 
-    Url::Url(const std::string &baseUrl, const std::map<std::string, std::string> &params,
-        const std::map<std::string, std::string> &oauthParams)
+    Url::Url(const std::string &baseUrl, const UrlParams &params, const UrlParams &oauthParams)
         : changed_(true), baseUrl_(baseUrl), params_(params), oauthParams_(oauthParams)
     {
     }
 
-    void Url::assign(const std::string &baseUrl, const std::map<std::string, std::string> &params,
-        const std::map<std::string, std::string> &oauthParams)
+    void Url::assign(const std::string &baseUrl, const UrlParams &params, const UrlParams &oauthParams)
     {
         baseUrl_ = baseUrl;
         params_ = params;
@@ -26,12 +122,12 @@ namespace Maragi
         changed_ = true;
     }
 
-    bool Url::hasParam(const std::string &key) const
+    bool Url::hasParam(boost::string_view key) const
     {
         return params_.find(key) != params_.end();
     }
 
-    const std::string &Url::getParam(const std::string &key) const
+    const std::string &Url::getParam(boost::string_view key) const
     {
         static std::string empty;
         auto it = params_.find(key);
@@ -40,9 +136,9 @@ namespace Maragi
         return empty;
     }
 
-    bool Url::addParam(const std::string &key, const std::string &value)
+    bool Url::addParam(boost::string_view key, boost::string_view value)
     {
-        if(params_.insert(make_pair(key, value)).second)
+        if(params_.insert(key, value))
         {
             changed_ = true;
             return true;
@@ -50,18 +146,26 @@ namespace Maragi
         return false;
     }
 
-    void Url::removeParam(const std::string &key)
+    void Url::setParam(boost::string_view key, boost::string_view value)
     {
-        params_.erase(key);
+        params_.set(key, value);
         changed_ = true;
     }
 
-    bool Url::hasOAuthParam(const std::string &key) const
+    void Url::removeParam(boost::string_view key)
+    {
+        if(params_.erase(key))
+            changed_ = true;
+    }
+
+    // OAuth parameters go in the Authorization header, so they leave the composed URL alone.
+
+    bool Url::hasOAuthParam(boost::string_view key) const
     {
         return oauthParams_.find(key) != oauthParams_.end();
     }
 
-    const std::string &Url::getOAuthParam(const std::string &key) const
+    const std::string &Url::getOAuthParam(boost::string_view key) const
     {
         static std::string empty;
         auto it = oauthParams_.find(key);
@@ -70,20 +174,19 @@ namespace Maragi
         return empty;
     }
 
-    bool Url::addOAuthParam(const std::string &key, const std::string &value)
+    bool Url::addOAuthParam(boost::string_view key, boost::string_view value)
     {
-        if(oauthParams_.insert(make_pair(key, value)).second)
-        {
-            changed_ = true;
-            return true;
-        }
-        return false;
+        return oauthParams_.insert(key, value);
+    }
+
+    void Url::setOAuthParam(boost::string_view key, boost::string_view value)
+    {
+        oauthParams_.set(key, value);
     }
 
-    void Url::removeOAuthParam(const std::string &key)
+    void Url::removeOAuthParam(boost::string_view key)
     {
         oauthParams_.erase(key);
-        changed_ = true;
     }
 
     const std::string &Url::baseUrl() const
@@ -97,53 +200,49 @@ namespace Maragi
         changed_ = true;
     }
 
-    const std::map<std::string, std::string> &Url::params() const
+    const UrlParams &Url::params() const
     {
         return params_;
     }
 
-    void Url::params(const std::map<std::string, std::string> &params)
+    void Url::params(const UrlParams &params)
     {
         params_ = params;
         changed_ = true;
     }
 
-    const std::map<std::string, std::string> &Url::oauthParams() const
+    const UrlParams &Url::oauthParams() const
     {
         return oauthParams_;
     }
 
-    void Url::oauthParams(const std::map<std::string, std::string> &oauthParams)
+    void Url::oauthParams(const UrlParams &oauthParams)
     {
         oauthParams_ = oauthParams;
-        changed_ = true;
     }
 
-    std::string Url::compose() const
+    const std::string &Url::compose() const
     {
         if(changed_)
         {
-            composedUrl_ = baseUrl_;
-            if(!params_.empty())
-            {
-                auto it = params_.begin();
-                composedUrl_ += "?";
-                composedUrl_ += Batang::encodeUrlParam(it->first);
-                composedUrl_ += "=";
-                composedUrl_ += Batang::encodeUrlParam(it->second);
-                for(++ it; it != params_.end(); ++ it)
-                {
-                    composedUrl_ += "&";
-                    composedUrl_ += Batang::encodeUrlParam(it->first);
-                    composedUrl_ += "=";
-                    composedUrl_ += Batang::encodeUrlParam(it->second);
-                }
-            }
+            composedUrl_.clear();
+            compose(composedUrl_);
+            changed_ = false;
         }
 
         return composedUrl_;
     }
 
+    void Url::compose(std::string &out) const
+    {
+        out += baseUrl_;
+        if(!params_.empty())
+        {
+            out += '?';
+            params_.encode(out);
+        }
+    }
+
     Url::operator std::string() const
     {
         return compose();
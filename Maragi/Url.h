@@ -2,49 +2,78 @@
 
 namespace Maragi
 {
+    // Request parameters sorted by name, one value each.
+    // A request carries a handful, so a sorted vector finds one as fast as a tree and is walked in order
+    // without chasing nodes; set() and clear() reuse the strings already allocated.
+    class UrlParams final
+    {
+    public:
+        typedef std::pair<std::string, std::string> value_type;
+        typedef std::vector<value_type>::const_iterator const_iterator;
+
+    private:
+        std::vector<value_type> items_;
+
+    public:
+        UrlParams();
+        UrlParams(std::initializer_list<value_type>); // a name given twice keeps the first value
+
+    public:
+        const_iterator begin() const;
+        const_iterator end() const;
+        size_t size() const;
+        bool empty() const;
+        const_iterator find(boost::string_view) const;
+
+        bool insert(boost::string_view, boost::string_view); // false, changing nothing, if the name is there
+        void set(boost::string_view, boost::string_view);
+        bool erase(boost::string_view);
+        void clear();
+
+        void encode(std::string &) const; // appends name=value&... as a query string or form body
+
+    private:
+        std::vector<value_type>::iterator lowerBound(boost::string_view);
+    };
+
     class Url final
     {
     private:
         std::string baseUrl_;
-        std::map<std::string, std::string> params_;
-        std::map<std::string, std::string> oauthParams_;
+        UrlParams params_;
+        UrlParams oauthParams_;
         mutable bool changed_;
         mutable std::string composedUrl_;
 
     public:
         Url();
-        Url(
-            const std::string &,
-            const std::map<std::string, std::string> & = std::map<std::string, std::string>(),
-            const std::map<std::string, std::string> & = std::map<std::string, std::string>()
-        );
+        Url(const std::string &, const UrlParams & = UrlParams(), const UrlParams & = UrlParams());
         Url(const Url &) = default;
         Url(Url &&) = default;
 
     public:
-        void assign(
-            const std::string &,
-            const std::map<std::string, std::string> & = std::map<std::string, std::string>(),
-            const std::map<std::string, std::string> & = std::map<std::string, std::string>()
-        );
-
-        bool hasParam(const std::string &) const;
-        const std::string &getParam(const std::string &) const;
-        bool addParam(const std::string &, const std::string &);
-        void removeParam(const std::string &);
-
-        bool hasOAuthParam(const std::string &) const;
-        const std::string &getOAuthParam(const std::string &) const;
-        bool addOAuthParam(const std::string &, const std::string &);
-        void removeOAuthParam(const std::string &);
+        void assign(const std::string &, const UrlParams & = UrlParams(), const UrlParams & = UrlParams());
+
+        bool hasParam(boost::string_view) const;
+        const std::string &getParam(boost::string_view) const;
+        bool addParam(boost::string_view, boost::string_view);
+        void setParam(boost::string_view, boost::string_view);
+        void removeParam(boost::string_view);
+
+        bool hasOAuthParam(boost::string_view) const;
+        const std::string &getOAuthParam(boost::string_view) const;
+        bool addOAuthParam(boost::string_view, boost::string_view);
+        void setOAuthParam(boost::string_view, boost::string_view);
+        void removeOAuthParam(boost::string_view);
 
         const std::string &baseUrl() const;
         void baseUrl(const std::string &);
-        const std::map<std::string, std::string> &params() const;
-        void params(const std::map<std::string, std::string> &);
-        const std::map<std::string, std::string> &oauthParams() const;
-        void oauthParams(const std::map<std::string, std::string> &);
-        std::string compose() const;
+        const UrlParams &params() const;
+        void params(const UrlParams &);
+        const UrlParams &oauthParams() const;
+        void oauthParams(const UrlParams &);
+        const std::string &compose() const; // cached until the base URL or a parameter changes
+        void compose(std::string &) const; // appends, leaving the cache alone
 
     public:
         Url &operator =(const Url &) = default;